@@ -0,0 +1,493 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <tree.hh>
+#include <tries.hh>
+#include <static_tries.hh>
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Insert, find, in order traversal and memory per element for every bst
+// variant, tries and std::map / std::unordered_map baselines.
+//
+// Names are operation/container/workload/size, for example
+// find/red_black/zipfian/1000000. Sizes go from 1K to 100M, use
+// --benchmark_filter to pick a subset and
+// --benchmark_out=result.json --benchmark_out_format=json for JSON output.
+//
+// find_copy and find_view look up std::string keys from std::string_view,
+// building a std::string per lookup and passing the view as it is.
+
+// Every allocation in this binary is counted, memory per element is the
+// growth while a container is being filled
+static std::atomic<size_t> allocated_bytes { 0 };
+static std::atomic<size_t> allocation_count { 0 };
+
+static void * counted_allocate(size_t size, size_t alignment) {
+    void *ptr = nullptr;
+    if (alignment <= alignof(std::max_align_t)) ptr = std::malloc(size ? size : 1);
+    else if (posix_memalign(&ptr, alignment, size ? size : 1) != 0) ptr = nullptr;
+    if (ptr == nullptr) throw std::bad_alloc();
+    allocated_bytes.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return ptr;
+}
+
+static void counted_free(void *ptr) noexcept {
+    if (ptr == nullptr) return;
+    allocated_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+    std::free(ptr);
+}
+
+void * operator new(size_t size) { return counted_allocate(size, 0); }
+void * operator new[](size_t size) { return counted_allocate(size, 0); }
+void * operator new(size_t size, std::align_val_t alignment) { return counted_allocate(size, static_cast<size_t>(alignment)); }
+void * operator new[](size_t size, std::align_val_t alignment) { return counted_allocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void *ptr) noexcept { counted_free(ptr); }
+void operator delete[](void *ptr) noexcept { counted_free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { counted_free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { counted_free(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { counted_free(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { counted_free(ptr); }
+
+enum class workload {
+    uniform,
+    sequential,
+    zipfian,
+    string
+};
+
+static const char * workload_name(workload type) {
+    switch(type) {
+    case workload::uniform: return "uniform";
+    case workload::sequential: return "sequential";
+    case workload::zipfian: return "zipfian";
+    case workload::string: return "string";
+    }
+    return "";
+}
+
+static uint64_t splitmix(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+// Gray et al. "Quickly generating billion-record synthetic databases",
+// same generator YCSB uses. Rank 0 is the most popular item.
+class zipfian_generator {
+    uint64_t items;
+    double theta;
+    double zeta_n;
+    double alpha;
+    double eta;
+
+    static double zeta(uint64_t count, double theta) {
+        double result = 0;
+        for(uint64_t index = 1; index <= count; ++index) {
+            result += 1.0 / std::pow(static_cast<double>(index), theta);
+        }
+        return result;
+    }
+
+public:
+    zipfian_generator(uint64_t items, double theta = 0.99)
+        : items(items), theta(theta), zeta_n(zeta(items, theta)), alpha(1.0 / (1.0 - theta)) {
+        eta = (1.0 - std::pow(2.0 / items, 1.0 - theta)) / (1.0 - zeta(2, theta) / zeta_n);
+    }
+
+    template <typename random_type>
+    uint64_t operator()(random_type &random) {
+        auto u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        auto uz = u * zeta_n;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, theta)) return 1;
+        return std::min(items - 1, static_cast<uint64_t>(items * std::pow(eta * u - eta + 1.0, alpha)));
+    }
+};
+
+// Keys to insert and keys to look up. Only last generated set is cached,
+// largest sets are several GB.
+template <typename key_type>
+struct key_set {
+    workload type;
+    size_t size = 0;
+    std::vector<key_type> insert;
+    std::vector<key_type> find;
+};
+
+static std::string string_key(uint64_t value) {
+    char buffer[24];
+    std::snprintf(buffer, sizeof(buffer), "user%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+template <typename key_type>
+const key_set<key_type> & keys(workload type, size_t size) {
+    static key_set<key_type> cache;
+    if (cache.size == size && cache.type == type) return cache;
+
+    cache.insert.clear();
+    cache.insert.shrink_to_fit();
+    cache.find.clear();
+    cache.find.shrink_to_fit();
+    cache.type = type;
+    cache.size = size;
+
+    std::mt19937_64 random(size);
+    std::vector<uint64_t> values(size);
+    if (type == workload::sequential) {
+        for(size_t index = 0; index < size; ++index) values[index] = index;
+    } else if (type == workload::zipfian) {
+        zipfian_generator generator(size);
+        for(auto &value: values) value = splitmix(generator(random));
+    } else {
+        for(auto &value: values) value = random();
+    }
+
+    // Lookups hit inserted keys, zipfian lookups follow same skew
+    auto lookup = values;
+    if (type == workload::zipfian) {
+        zipfian_generator generator(size);
+        for(auto &value: lookup) value = splitmix(generator(random));
+    } else {
+        std::shuffle(lookup.begin(), lookup.end(), random);
+    }
+
+    if constexpr (std::is_same_v<key_type, std::string>) {
+        cache.insert.reserve(size);
+        for(auto value: values) cache.insert.push_back(string_key(value));
+        cache.find.reserve(size);
+        for(auto value: lookup) cache.find.push_back(string_key(value));
+    } else {
+        cache.insert = std::move(values);
+        cache.find = std::move(lookup);
+    }
+    return cache;
+}
+
+// Uniform interface over benchmarked containers
+template <typename key_type, rohit::blancing_type impl>
+void insert(rohit::bst<key_type, uint64_t, impl> &container, const key_type &key) {
+    container.insert(key, 1);
+}
+
+template <typename key_type, typename mapped_type>
+void insert(std::map<key_type, mapped_type> &container, const key_type &key) {
+    container.insert_or_assign(key, 1);
+}
+
+template <typename key_type, typename mapped_type>
+void insert(std::unordered_map<key_type, mapped_type> &container, const key_type &key) {
+    container.insert_or_assign(key, 1);
+}
+
+template <typename TLIST>
+void insert(rohit::tries_set<std::string, TLIST> &container, const std::string &key) {
+    container.insert(key);
+}
+
+// Build once containers take all keys at construction
+template <typename container_type, typename key_type>
+void fill(container_type &container, const std::vector<key_type> &keys) {
+    if constexpr (std::is_constructible_v<container_type, const std::vector<key_type> &>) {
+        container = container_type(keys);
+    } else {
+        for(auto &key: keys) insert(container, key);
+    }
+}
+
+template <typename container_type, typename key_type>
+bool contains(container_type &container, const key_type &key) {
+    if constexpr (requires { container.contains(key); }) return container.contains(key);
+    else return container.find(key) != container.end();
+}
+
+template <typename entry_type>
+uint64_t entry_value(const entry_type &entry) {
+    if constexpr (requires { entry.second; }) return entry.second;
+    else return entry.value;
+}
+
+template <typename container_type, typename key_type>
+void insert_benchmark(benchmark::State &state, workload type) {
+    auto &set = keys<key_type>(type, state.range(0));
+    double bytes_per_element = 0;
+    for(auto _: state) {
+        auto before = allocated_bytes.load(std::memory_order_relaxed);
+        {
+            container_type container;
+            fill(container, set.insert);
+            benchmark::DoNotOptimize(container);
+            state.PauseTiming();
+            size_t elements = 0;
+            if constexpr (requires { container.size(); }) elements = container.size();
+            else elements = set.insert.size();
+            bytes_per_element = static_cast<double>(allocated_bytes.load(std::memory_order_relaxed) - before) / elements;
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * set.insert.size());
+    state.counters["bytes_per_element"] = bytes_per_element;
+}
+
+template <typename container_type, typename key_type>
+void find_benchmark(benchmark::State &state, workload type) {
+    auto &set = keys<key_type>(type, state.range(0));
+    container_type container;
+    fill(container, set.insert);
+
+    for(auto _: state) {
+        size_t found = 0;
+        for(auto &key: set.find) found += contains(container, key);
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * set.find.size());
+}
+
+template <typename container_type, typename key_type>
+void traversal_benchmark(benchmark::State &state, workload type) {
+    auto &set = keys<key_type>(type, state.range(0));
+    container_type container;
+    fill(container, set.insert);
+
+    size_t elements = 0;
+    for(auto _: state) {
+        uint64_t sum = 0;
+        elements = 0;
+        if constexpr (requires { container.begin(); }) {
+            for(auto &entry: container) {
+                sum += entry_value(entry);
+                ++elements;
+            }
+        } else {
+            // Tries have no iterator, keys are rebuilt by a for_each walk
+            container.for_each([&sum, &elements](const auto &key, const auto &value) {
+                sum += key.size() + value;
+                ++elements;
+            });
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * elements);
+}
+
+// Keys are 20 characters, longer than small string buffer, so every copy
+// allocates
+template <typename container_type, bool transparent>
+void view_lookup_benchmark(benchmark::State &state) {
+    auto &set = keys<std::string>(workload::string, state.range(0));
+    container_type container;
+    fill(container, set.insert);
+    std::vector<std::string_view> views(set.find.begin(), set.find.end());
+
+    size_t allocations = 0;
+    for(auto _: state) {
+        auto before = allocation_count.load(std::memory_order_relaxed);
+        size_t found = 0;
+        for(auto view: views) {
+            if constexpr (transparent) found += contains(container, view);
+            else found += contains(container, std::string(view));
+        }
+        benchmark::DoNotOptimize(found);
+        allocations += allocation_count.load(std::memory_order_relaxed) - before;
+    }
+    state.SetItemsProcessed(state.iterations() * views.size());
+    state.counters["allocations_per_lookup"] = static_cast<double>(allocations) / (state.iterations() * views.size());
+}
+
+// Lookups in requests of batch_size keys, answered by a loop of single
+// lookups or by one batched call per request
+constexpr size_t batch_size = 64;
+
+template <typename key_type, rohit::blancing_type impl>
+size_t count_batch(rohit::bst<key_type, uint64_t, impl> &container, std::span<const key_type> keys) {
+    typename rohit::bst<key_type, uint64_t, impl>::iterator results[batch_size];
+    container.find_batch(keys, results);
+    size_t found = 0;
+    for(size_t index = 0; index < keys.size(); ++index) found += results[index] != container.end();
+    return found;
+}
+
+template <typename TLIST>
+size_t count_batch(rohit::tries_set<std::string, TLIST> &container, std::span<const std::string> keys) {
+    bool results[batch_size];
+    container.contains_batch(keys, results);
+    return std::count(results, results + keys.size(), true);
+}
+
+template <typename container_type, typename key_type, bool batched>
+void batch_lookup_benchmark(benchmark::State &state, workload type) {
+    auto &set = keys<key_type>(type, state.range(0));
+    container_type container;
+    fill(container, set.insert);
+
+    for(auto _: state) {
+        size_t found = 0;
+        for(size_t first = 0; first < set.find.size(); first += batch_size) {
+            std::span<const key_type> request(set.find.data() + first, std::min(batch_size, set.find.size() - first));
+            if constexpr (batched) {
+                found += count_batch(container, request);
+            } else {
+                for(auto &key: request) found += contains(container, key);
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * set.find.size());
+}
+
+// Shard of size / 16 uniform keys merged into tree of size uniform keys,
+// by re-inserting every element or by union_with, which inserts too below
+// union_insert_ratio
+template <typename container_type, bool join_based>
+void merge_benchmark(benchmark::State &state) {
+    auto &set = keys<uint64_t>(workload::uniform, state.range(0));
+    std::vector<uint64_t> shard(set.find.begin(), set.find.begin() + set.find.size() / 16);
+    for(auto _: state) {
+        state.PauseTiming();
+        container_type container, other;
+        fill(container, set.insert);
+        fill(other, shard);
+        state.ResumeTiming();
+        if constexpr (join_based) {
+            container.union_with(other);
+        } else {
+            for(auto &entry: other) container.insert(entry.key, entry.value);
+        }
+        benchmark::DoNotOptimize(container);
+        state.PauseTiming();
+        {
+            // Trees are freed untimed
+            auto drop = std::move(container);
+            auto drop_other = std::move(other);
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * shard.size());
+}
+
+constexpr int64_t min_size = 1000;
+constexpr int64_t max_size = 100000000;
+// Unbalanced tree is quadratic on sorted input
+constexpr int64_t max_unbalanced_sequential = 10000;
+
+template <typename container_type, typename key_type, bool traversable = true>
+void register_container(const std::string &name, workload type, int64_t max = max_size) {
+    auto suffix = name + "/" + workload_name(type);
+    auto apply = [max](benchmark::internal::Benchmark *bench) {
+        bench->RangeMultiplier(10)->Range(min_size, max)->Unit(benchmark::kMillisecond);
+    };
+    apply(benchmark::RegisterBenchmark(("insert/" + suffix).c_str(), insert_benchmark<container_type, key_type>, type));
+    apply(benchmark::RegisterBenchmark(("find/" + suffix).c_str(), find_benchmark<container_type, key_type>, type));
+    if constexpr (traversable) {
+        apply(benchmark::RegisterBenchmark(("traversal/" + suffix).c_str(), traversal_benchmark<container_type, key_type>, type));
+    }
+}
+
+template <typename container_type>
+void register_view_lookup(const std::string &name) {
+    auto apply = [](benchmark::internal::Benchmark *bench) {
+        bench->RangeMultiplier(10)->Range(min_size, max_size)->Unit(benchmark::kMillisecond);
+    };
+    apply(benchmark::RegisterBenchmark(("find_copy/" + name + "/string").c_str(), view_lookup_benchmark<container_type, false>));
+    apply(benchmark::RegisterBenchmark(("find_view/" + name + "/string").c_str(), view_lookup_benchmark<container_type, true>));
+}
+
+template <typename container_type>
+void register_merge(const std::string &name) {
+    auto apply = [](benchmark::internal::Benchmark *bench) {
+        bench->RangeMultiplier(10)->Range(min_size * 10, max_size / 10)->Unit(benchmark::kMillisecond);
+    };
+    apply(benchmark::RegisterBenchmark(("merge_insert/" + name + "/uniform").c_str(), merge_benchmark<container_type, false>));
+    apply(benchmark::RegisterBenchmark(("merge_union/" + name + "/uniform").c_str(), merge_benchmark<container_type, true>));
+}
+
+template <typename container_type, typename key_type>
+void register_batch(const std::string &name, workload type) {
+    auto suffix = name + "/" + workload_name(type);
+    auto apply = [](benchmark::internal::Benchmark *bench) {
+        bench->RangeMultiplier(10)->Range(min_size, max_size / 10)->Unit(benchmark::kMillisecond);
+    };
+    apply(benchmark::RegisterBenchmark(("find_loop/" + suffix).c_str(), batch_lookup_benchmark<container_type, key_type, false>, type));
+    apply(benchmark::RegisterBenchmark(("find_batch/" + suffix).c_str(), batch_lookup_benchmark<container_type, key_type, true>, type));
+}
+
+template <typename key_type>
+void register_all(workload type) {
+    using value_type = uint64_t;
+    auto none_max = type == workload::sequential ? max_unbalanced_sequential : max_size;
+    register_container<rohit::bst<key_type, value_type, rohit::blancing_type::none>, key_type>("none", type, none_max);
+    register_container<rohit::bst<key_type, value_type, rohit::blancing_type::red_black>, key_type>("red_black", type);
+    register_container<rohit::bst<key_type, value_type, rohit::blancing_type::red_black_leftleaning>, key_type>("red_black_leftleaning", type);
+    register_container<rohit::bst<key_type, value_type, rohit::blancing_type::avl>, key_type>("avl", type);
+    register_container<std::map<key_type, value_type>, key_type>("std_map", type);
+    register_container<std::unordered_map<key_type, value_type>, key_type>("std_unordered_map", type);
+
+    if constexpr (std::is_same_v<key_type, std::string>) {
+        register_container<rohit::tries_set<std::string, rohit::tries_unordered_map<std::string>>, key_type>("tries_unordered_map", type);
+        register_container<rohit::tries_set<std::string, rohit::tries_tree<std::string, bool, rohit::blancing_type::red_black>>, key_type>("tries_red_black", type);
+        register_container<rohit::tries_set<std::string, rohit::tries_btree<std::string>>, key_type>("tries_btree", type);
+        register_container<rohit::tries_set<std::string, rohit::tries_art<std::string>>, key_type>("tries_art", type);
+        register_container<rohit::tries_set<std::string, rohit::tries_flat<std::string>>, key_type>("tries_flat", type);
+        // static_tries has no walk over its keys
+        register_container<rohit::static_tries<std::string>, key_type, false>("static_tries", type);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    register_all<uint64_t>(workload::uniform);
+    register_all<uint64_t>(workload::sequential);
+    register_all<uint64_t>(workload::zipfian);
+    register_all<std::string>(workload::string);
+
+    register_view_lookup<rohit::bst<std::string, uint64_t, rohit::blancing_type::red_black>>("red_black");
+    register_view_lookup<rohit::tries_set<std::string, rohit::tries_art<std::string>>>("tries_art");
+    register_view_lookup<rohit::tries_set<std::string, rohit::tries_flat<std::string>>>("tries_flat");
+    register_view_lookup<rohit::static_tries<std::string>>("static_tries");
+
+    register_batch<rohit::bst<uint64_t, uint64_t, rohit::blancing_type::red_black>, uint64_t>("red_black", workload::uniform);
+    register_batch<rohit::bst<uint64_t, uint64_t, rohit::blancing_type::avl>, uint64_t>("avl", workload::uniform);
+    register_batch<rohit::bst<std::string, uint64_t, rohit::blancing_type::red_black>, std::string>("red_black", workload::string);
+    register_batch<rohit::tries_set<std::string, rohit::tries_art<std::string>>, std::string>("tries_art", workload::string);
+    register_batch<rohit::tries_set<std::string, rohit::tries_flat<std::string>>, std::string>("tries_flat", workload::string);
+
+    register_merge<rohit::bst<uint64_t, uint64_t, rohit::blancing_type::red_black>>("red_black");
+    register_merge<rohit::bst<uint64_t, uint64_t, rohit::blancing_type::avl>>("avl");
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
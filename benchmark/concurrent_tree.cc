@@ -0,0 +1,100 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <concurrent_tree.hh>
+#include <tree.hh>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Lookup throughput of a shared tree, concurrent_bst against bst behind one
+// global mutex. Every thread does read_percent finds, rest are inserts.
+// usage: BenchmarkConcurrentTree [max_threads] [operations_per_thread] [read_percent]
+
+constexpr uint64_t key_count = 1 << 20;
+
+class locked_bst {
+    std::mutex lock;
+    rohit::bst<uint64_t, uint64_t, rohit::blancing_type::red_black> tree;
+
+public:
+    void insert(uint64_t key, uint64_t value) {
+        std::lock_guard<std::mutex> guard(lock);
+        tree.insert(key, value);
+    }
+
+    bool contains(uint64_t key) {
+        std::lock_guard<std::mutex> guard(lock);
+        return tree.find(key) != tree.end();
+    }
+};
+
+template <typename tree_type>
+double run(tree_type &tree, size_t thread_count, size_t operations, unsigned read_percent) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t index = 0; index < thread_count; ++index) {
+        threads.emplace_back([&tree, index, operations, read_percent] {
+            std::mt19937_64 random(index + 1);
+            size_t found = 0;
+            for(size_t count = 0; count < operations; ++count) {
+                auto key = random() % (2 * key_count);
+                if (random() % 100 < read_percent) found += tree.contains(key);
+                else tree.insert(key, key);
+            }
+            // Keeps lookups from being optimised away
+            if (found == operations + 1) std::cout << "";
+        });
+    }
+    for(auto &thread: threads) thread.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return thread_count * operations / elapsed.count();
+}
+
+template <typename tree_type>
+void fill(tree_type &tree) {
+    std::mt19937_64 random(0);
+    for(uint64_t count = 0; count < key_count; ++count) {
+        auto key = random() % (2 * key_count);
+        tree.insert(key, key);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    size_t operations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+    unsigned read_percent = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 99;
+
+    rohit::concurrent_bst<uint64_t, uint64_t, rohit::blancing_type::red_black> concurrent_tree;
+    locked_bst locked_tree;
+    fill(concurrent_tree);
+    fill(locked_tree);
+
+    std::cout << "Read percent: " << read_percent << "; operations per thread: " << operations << std::endl;
+    std::cout << "threads\tconcurrent_bst (ops/s)\tmutex bst (ops/s)" << std::endl;
+    for(size_t thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+        auto concurrent = run(concurrent_tree, thread_count, operations, read_percent);
+        auto locked = run(locked_tree, thread_count, operations, read_percent);
+        std::cout << thread_count << "\t" << concurrent << "\t" << locked << std::endl;
+    }
+
+    return 0;
+}
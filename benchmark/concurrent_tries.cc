@@ -0,0 +1,109 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <concurrent_tries.hh>
+#include <tries.hh>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Throughput of a shared string set, concurrent_tries_set against tries_set
+// behind one global mutex. Every thread does read_percent lookups, rest are
+// inserts of new keys, default is an ingestion load with no lookups.
+// usage: BenchmarkConcurrentTries [max_threads] [operations_per_thread] [read_percent]
+
+constexpr uint64_t key_count = 1 << 20;
+
+static std::string string_key(uint64_t value) {
+    char buffer[24];
+    std::snprintf(buffer, sizeof(buffer), "user%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+class locked_tries {
+    std::mutex lock;
+    rohit::tries_set<std::string, rohit::tries_art<std::string>> tries;
+
+public:
+    void insert(const std::string &key) {
+        std::lock_guard<std::mutex> guard(lock);
+        tries.insert(key);
+    }
+
+    bool contains(const std::string &key) {
+        std::lock_guard<std::mutex> guard(lock);
+        return tries.contains(key);
+    }
+};
+
+template <typename tries_type>
+double run(tries_type &tries, size_t thread_count, size_t operations, unsigned read_percent, uint64_t seed) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t index = 0; index < thread_count; ++index) {
+        threads.emplace_back([&tries, index, operations, read_percent, seed] {
+            std::mt19937_64 random(seed + index + 1);
+            size_t found = 0;
+            for(size_t count = 0; count < operations; ++count) {
+                auto key = string_key(random());
+                if (random() % 100 < read_percent) found += tries.contains(key);
+                else tries.insert(key);
+            }
+            // Keeps lookups from being optimised away
+            if (found == operations + 1) std::cout << "";
+        });
+    }
+    for(auto &thread: threads) thread.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return thread_count * operations / elapsed.count();
+}
+
+template <typename tries_type>
+void fill(tries_type &tries) {
+    std::mt19937_64 random(0);
+    for(uint64_t count = 0; count < key_count; ++count) {
+        tries.insert(string_key(random()));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    size_t operations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+    unsigned read_percent = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 0;
+
+    rohit::concurrent_tries_set<std::string> concurrent;
+    locked_tries locked;
+    fill(concurrent);
+    fill(locked);
+
+    std::cout << "Read percent: " << read_percent << "; operations per thread: " << operations << std::endl;
+    std::cout << "threads\tconcurrent_tries (ops/s)\tmutex tries_art (ops/s)" << std::endl;
+    for(size_t thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+        // Every round inserts keys not seen before
+        auto concurrent_rate = run(concurrent, thread_count, operations, read_percent, thread_count * 1000);
+        auto locked_rate = run(locked, thread_count, operations, read_percent, thread_count * 1000);
+        std::cout << thread_count << "\t" << concurrent_rate << "\t" << locked_rate << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <tree.hh>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+// Iterative insert of every balanced bst against std::map, which is a red
+// black tree with bottom up insert. Sizes grow ten fold from 1K up to max_size.
+// usage: BenchmarkInsert [max_size]
+
+template <typename tree_type, typename insert_type>
+double measure(const std::vector<uint64_t> &keys, insert_type insert) {
+    tree_type tree;
+    auto start = std::chrono::steady_clock::now();
+    for(auto key: keys) {
+        insert(tree, key);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / keys.size();
+}
+
+template <rohit::blancing_type impl>
+void run(const char *name, const std::vector<uint64_t> &keys, double map_insert) {
+    using tree_type = rohit::bst<uint64_t, uint64_t, impl>;
+    auto iterative = measure<tree_type>(keys, [](tree_type &tree, uint64_t key) { tree.insert(key, key); });
+    std::cout << keys.size() << "\t" << name << "\t" << iterative << "\t" << map_insert << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000;
+
+    std::cout << "size\ttree\tbst (ns/insert)\tstd::map (ns/insert)" << std::endl;
+    std::mt19937_64 random(0);
+    for(size_t size = 1000; size <= max_size; size *= 10) {
+        std::vector<uint64_t> keys(size);
+        for(auto &key: keys) key = random();
+
+        using map_type = std::map<uint64_t, uint64_t>;
+        auto map_insert = measure<map_type>(keys, [](map_type &map, uint64_t key) { map.insert_or_assign(key, key); });
+        run<rohit::blancing_type::red_black>("red_black", keys, map_insert);
+        run<rohit::blancing_type::red_black_leftleaning>("red_black_leftleaning", keys, map_insert);
+        run<rohit::blancing_type::avl>("avl", keys, map_insert);
+    }
+
+    return 0;
+}
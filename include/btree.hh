@@ -0,0 +1,364 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <slab_allocator.hh>
+#include <simd_search.hh>
+#include <assert.h>
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace rohit {
+
+// B+tree, all key value pairs are kept in leaves and leaves are linked in key
+// order for range scan. Node capacity is derived from node_bytes so that one
+// node spans a few cache lines (or a page for large node_bytes).
+template <typename key_type, typename value_type, size_t node_bytes>
+struct btree_node {
+    uint16_t count = 0;
+    bool leaf;
+
+    btree_node(bool leaf) : leaf(leaf) { }
+}; // struct btree_node
+
+template <typename key_type, typename value_type, size_t node_bytes>
+struct btree_leaf : public btree_node<key_type, value_type, node_bytes> {
+    using base_type = btree_node<key_type, value_type, node_bytes>;
+    static constexpr size_t header_size = sizeof(base_type) + sizeof(void *);
+    static constexpr size_t fit_count = node_bytes > header_size ? (node_bytes - header_size) / (sizeof(key_type) + sizeof(value_type)) : 0;
+    static constexpr size_t capacity = std::max<size_t>(4, fit_count);
+
+    key_type keys[capacity];
+    value_type values[capacity];
+    btree_leaf *next = nullptr;
+
+    btree_leaf() : base_type(true) { }
+}; // struct btree_leaf
+
+template <typename key_type, typename value_type, size_t node_bytes>
+struct btree_inner : public btree_node<key_type, value_type, node_bytes> {
+    using base_type = btree_node<key_type, value_type, node_bytes>;
+    static constexpr size_t header_size = sizeof(base_type) + sizeof(void *);
+    static constexpr size_t fit_count = node_bytes > header_size ? (node_bytes - header_size) / (sizeof(key_type) + sizeof(void *)) : 0;
+    static constexpr size_t capacity = std::max<size_t>(4, fit_count);
+
+    // children[i] holds keys in [keys[i - 1], keys[i])
+    key_type keys[capacity];
+    base_type *children[capacity + 1];
+
+    btree_inner() : base_type(false) { }
+}; // struct btree_inner
+
+template <typename key_type, typename value_type, size_t node_bytes = 256,
+    typename allocator_type = slab_allocator<btree_leaf<key_type, value_type, node_bytes>>>
+    requires std::totally_ordered<key_type> && std::default_initializable<key_type> && std::default_initializable<value_type>
+class btree {
+public:
+    using node_type = btree_node<key_type, value_type, node_bytes>;
+    using leaf_type = btree_leaf<key_type, value_type, node_bytes>;
+    using inner_type = btree_inner<key_type, value_type, node_bytes>;
+    using leaf_allocator_type = std::allocator_traits<allocator_type>::template rebind_alloc<leaf_type>;
+    using inner_allocator_type = std::allocator_traits<allocator_type>::template rebind_alloc<inner_type>;
+    using leaf_allocator_traits = std::allocator_traits<leaf_allocator_type>;
+    using inner_allocator_traits = std::allocator_traits<inner_allocator_type>;
+
+    struct reference {
+        const key_type &key;
+        value_type &value;
+    };
+
+    class iterator {
+        leaf_type *leaf = nullptr;
+        size_t index = 0;
+
+        friend class btree;
+        iterator(leaf_type *leaf, size_t index) : leaf(leaf), index(index) { }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+
+        struct pointer {
+            reference ref;
+            reference *operator->() { return &ref; }
+        };
+
+        iterator() { }
+
+        reference operator*() const { return { leaf->keys[index], leaf->values[index] }; }
+        pointer operator->() const { return { **this }; }
+
+        iterator &operator++() {
+            if (++index == leaf->count) {
+                leaf = leaf->next;
+                index = 0;
+            }
+            return *this;
+        }
+
+        iterator operator++(int) {
+            auto result = *this;
+            ++*this;
+            return result;
+        }
+
+        bool operator==(const iterator &other) const = default;
+    };
+
+    node_type *root = nullptr;
+
+private:
+    leaf_type *first = nullptr;
+    size_t count = 0;
+    [[no_unique_address]] leaf_allocator_type leaf_allocator { };
+    [[no_unique_address]] inner_allocator_type inner_allocator { };
+
+    // Slab like allocators can drop all nodes at once, while no other
+    // allocator shares their pools
+    static constexpr bool releasable = requires(leaf_allocator_type &leaf_alloc, inner_allocator_type &inner_alloc) {
+        leaf_alloc.release();
+        inner_alloc.release();
+        { leaf_alloc.shared() } -> std::convertible_to<bool>;
+        { inner_alloc.shared() } -> std::convertible_to<bool>;
+    };
+
+    // Number of keys strictly less than key, whole node is compared at once for
+    // key types having vector kernels
+    static size_t lower_index(const key_type *keys, size_t size, const key_type &key) {
+        if constexpr (simd::search_supported<key_type>) {
+            return simd::lower_bound(keys, size, key);
+        } else {
+            return std::lower_bound(keys, keys + size, key) - keys;
+        }
+    }
+
+    // Number of keys less than or equal to key
+    static size_t upper_index(const key_type *keys, size_t size, const key_type &key) {
+        if constexpr (simd::search_supported<key_type>) {
+            return simd::upper_bound(keys, size, key);
+        } else {
+            return std::upper_bound(keys, keys + size, key) - keys;
+        }
+    }
+
+    leaf_type * create_leaf() {
+        auto leaf = leaf_allocator_traits::allocate(leaf_allocator, 1);
+        leaf_allocator_traits::construct(leaf_allocator, leaf);
+        return leaf;
+    }
+
+    inner_type * create_inner() {
+        auto inner = inner_allocator_traits::allocate(inner_allocator, 1);
+        inner_allocator_traits::construct(inner_allocator, inner);
+        return inner;
+    }
+
+    // Depth is log(n) with base of node capacity, recursion is fine here
+    // Memory is left to the pools when they are dropped afterwards
+    void destroy(node_type * node, bool drop_pool) {
+        if (node->leaf) {
+            auto leaf = static_cast<leaf_type *>(node);
+            leaf_allocator_traits::destroy(leaf_allocator, leaf);
+            if (!drop_pool) leaf_allocator_traits::deallocate(leaf_allocator, leaf, 1);
+        } else {
+            auto inner = static_cast<inner_type *>(node);
+            for(size_t index = 0; index <= inner->count; ++index) {
+                destroy(inner->children[index], drop_pool);
+            }
+            inner_allocator_traits::destroy(inner_allocator, inner);
+            if (!drop_pool) inner_allocator_traits::deallocate(inner_allocator, inner, 1);
+        }
+    }
+
+    static bool is_full(node_type * node) {
+        if (node->leaf) return node->count == leaf_type::capacity;
+        return node->count == inner_type::capacity;
+    }
+
+    // Splits full child at index, upper half moves to a new right sibling
+    void split_child(inner_type * parent, size_t index) {
+        auto child = parent->children[index];
+        key_type separator;
+        node_type *right_node;
+
+        if (child->leaf) {
+            auto left = static_cast<leaf_type *>(child);
+            auto right = create_leaf();
+            size_t mid = left->count / 2;
+            right->count = left->count - mid;
+            std::move(left->keys + mid, left->keys + left->count, right->keys);
+            std::move(left->values + mid, left->values + left->count, right->values);
+            left->count = mid;
+            right->next = left->next;
+            left->next = right;
+            separator = right->keys[0];
+            right_node = right;
+        } else {
+            auto left = static_cast<inner_type *>(child);
+            auto right = create_inner();
+            size_t mid = left->count / 2;
+            separator = std::move(left->keys[mid]);
+            right->count = left->count - mid - 1;
+            std::move(left->keys + mid + 1, left->keys + left->count, right->keys);
+            std::copy(left->children + mid + 1, left->children + left->count + 1, right->children);
+            left->count = mid;
+            right_node = right;
+        }
+
+        std::move_backward(parent->keys + index, parent->keys + parent->count, parent->keys + parent->count + 1);
+        std::copy_backward(parent->children + index + 1, parent->children + parent->count + 1, parent->children + parent->count + 2);
+        parent->keys[index] = std::move(separator);
+        parent->children[index + 1] = right_node;
+        ++parent->count;
+    }
+
+    size_t depth(node_type * node) {
+        size_t result = 0;
+        while(node) {
+            ++result;
+            if (node->leaf) break;
+            node = static_cast<inner_type *>(node)->children[0];
+        }
+        return result;
+    }
+
+public:
+    btree() { }
+    explicit btree(const allocator_type &alloc) : leaf_allocator(alloc), inner_allocator(alloc) { }
+
+    btree(const btree &) = delete;
+    btree &operator=(const btree &) = delete;
+
+    btree(btree &&other) noexcept
+        : root(std::exchange(other.root, nullptr)),
+          first(std::exchange(other.first, nullptr)),
+          count(std::exchange(other.count, 0)),
+          leaf_allocator(std::move(other.leaf_allocator)),
+          inner_allocator(std::move(other.inner_allocator)) { }
+
+    btree &operator=(btree &&other) noexcept {
+        if (this != &other) {
+            clear();
+            root = std::exchange(other.root, nullptr);
+            first = std::exchange(other.first, nullptr);
+            count = std::exchange(other.count, 0);
+            leaf_allocator = std::move(other.leaf_allocator);
+            inner_allocator = std::move(other.inner_allocator);
+        }
+        return *this;
+    }
+
+    ~btree() {
+        clear();
+    }
+
+    void clear() {
+        bool drop_pool = false;
+        if constexpr (releasable) drop_pool = !leaf_allocator.shared() && !inner_allocator.shared();
+        if (root != nullptr && (!drop_pool || !std::is_trivially_destructible_v<leaf_type> || !std::is_trivially_destructible_v<inner_type>)) {
+            destroy(root, drop_pool);
+        }
+
+        if constexpr (releasable) {
+            if (drop_pool) {
+                leaf_allocator.release();
+                inner_allocator.release();
+            }
+        }
+        root = nullptr;
+        first = nullptr;
+        count = 0;
+    }
+
+    // Duplicate will be overridden
+    void insert(const key_type &key, const value_type &value) {
+        if (root == nullptr) {
+            root = first = create_leaf();
+        }
+
+        // Full nodes are split on the way down so a split never propagates up
+        if (is_full(root)) {
+            auto newroot = create_inner();
+            newroot->children[0] = root;
+            split_child(newroot, 0);
+            root = newroot;
+        }
+
+        auto curr = root;
+        while(!curr->leaf) {
+            auto inner = static_cast<inner_type *>(curr);
+            auto index = upper_index(inner->keys, inner->count, key);
+            if (is_full(inner->children[index])) {
+                split_child(inner, index);
+                if (!(key < inner->keys[index])) ++index;
+            }
+            curr = inner->children[index];
+        }
+
+        auto leaf = static_cast<leaf_type *>(curr);
+        auto index = lower_index(leaf->keys, leaf->count, key);
+        if (index < leaf->count && leaf->keys[index] == key) {
+            leaf->values[index] = value;
+            return;
+        }
+
+        std::move_backward(leaf->keys + index, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        std::move_backward(leaf->values + index, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        leaf->keys[index] = key;
+        leaf->values[index] = value;
+        ++leaf->count;
+        ++count;
+    }
+
+    // First element not less than key
+    iterator lower_bound(const key_type &key) {
+        auto curr = root;
+        if (curr == nullptr) return end();
+        while(!curr->leaf) {
+            auto inner = static_cast<inner_type *>(curr);
+            curr = inner->children[upper_index(inner->keys, inner->count, key)];
+        }
+
+        auto leaf = static_cast<leaf_type *>(curr);
+        auto index = lower_index(leaf->keys, leaf->count, key);
+        if (index == leaf->count) return iterator(leaf->next, 0);
+        return iterator(leaf, index);
+    }
+
+    iterator find(const key_type &key) {
+        auto result = lower_bound(key);
+        if (result == end() || result->key != key) return end();
+        return result;
+    }
+
+    size_t depth() {
+        return depth(root);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    iterator begin() { return iterator(first, 0); }
+    iterator end() { return iterator(); }
+
+}; // class btree
+
+} // namespace rohit
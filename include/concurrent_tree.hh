@@ -0,0 +1,395 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <tree.hh>
+#include <epoch.hh>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace rohit {
+
+// Node augmentation of concurrent_bst, number of write which created node.
+// Only writer reads it, under its lock.
+struct write_generation { };
+
+template <>
+struct bst_node_augment<write_generation> {
+    uint64_t generation = 0;
+};
+
+// Read mostly bst. Published nodes are never modified: writer copies every
+// node it has to touch (path copying), then publishes the new root with a
+// single release store. Reader only loads root and walks plain pointers
+// inside an epoch, no lock and no atomic read-modify-write. Superseded
+// nodes are retired to epoch_domain and freed once no reader can see them.
+template <typename key_type, typename value_type, blancing_type impl>
+    requires std::totally_ordered<key_type>
+class concurrent_bst {
+public:
+    using node_type = bst_node<key_type, value_type, impl, write_generation>;
+
+    // Read only view of a found node. It keeps calling thread inside an
+    // epoch, so node is not reclaimed while iterator lives. Iterator must be
+    // destroyed by thread which created it, and should be short lived since
+    // it holds back reclamation.
+    class iterator {
+        const node_type *node = nullptr;
+
+        friend class concurrent_bst;
+
+        explicit iterator(const node_type *node) : node(node) {
+            if (node) epoch_domain::global().enter();
+        }
+
+    public:
+        iterator() { }
+        iterator(const iterator &other) : iterator(other.node) { }
+        iterator(iterator &&other) noexcept : node(std::exchange(other.node, nullptr)) { }
+
+        iterator &operator=(iterator other) noexcept {
+            std::swap(node, other.node);
+            return *this;
+        }
+
+        ~iterator() {
+            if (node) epoch_domain::global().leave();
+        }
+
+        const node_type &operator*() const { return *node; }
+        const node_type *operator->() const { return node; }
+
+        bool operator==(const iterator &other) const { return node == other.node; }
+    };
+
+private:
+    std::atomic<node_type *> root { nullptr };
+    std::atomic<size_t> count { 0 };
+
+    // Writer only state, guarded by write_mutex
+    std::mutex write_mutex;
+    uint64_t generation = 0;            // Current write, stamped on nodes it creates
+    std::vector<node_type *> fresh;     // Created by current write, not yet visible
+    std::vector<node_type *> replaced;  // Visible nodes superseded by a copy
+
+    node_type * create(const key_type &key, const value_type &value) {
+        auto node = std::make_unique<node_type>(std::in_place, key, value);
+        node->generation = generation;
+        fresh.push_back(node.get());
+        return node.release();
+    }
+
+    // node must still be visible to readers
+    node_type * copy(node_type * node) {
+        auto result = std::make_unique<node_type>(*node);
+        result->generation = generation;
+        fresh.push_back(result.get());
+        replaced.push_back(node);
+        return result.release();
+    }
+
+    // Returns a private copy which current write may modify
+    node_type * own(node_type * node) {
+        if (node->generation == generation) return node;
+        return copy(node);
+    }
+
+    // Write failed before publishing, readers never saw fresh nodes
+    void rollback() noexcept {
+        for(auto node: fresh) delete node;
+        fresh.clear();
+        replaced.clear();
+    }
+
+    static bool is_red(node_type * node) {
+        return node != nullptr && node->red;
+    }
+
+    static int height(node_type * node) {
+        return node ? node->count : 0;
+    }
+
+    // Caller must own _root and the child moving up
+    static node_type * rotate_left(node_type * _root) {
+        auto right = _root->right;
+        _root->right = right->left;
+        right->left = _root;
+        return right;
+    }
+
+    static node_type * rotate_right(node_type * _root) {
+        auto left = _root->left;
+        _root->left = left->right;
+        left->right = _root;
+        return left;
+    }
+
+    // Unbalanced tree can be deep, so it is copied iteratively
+    node_type * insert_none(node_type * curr, const key_type &key, const value_type &value, bool &inserted) {
+        node_type *newroot = nullptr;
+        node_type **link = &newroot;
+        while(curr) {
+            auto node = copy(curr);
+            *link = node;
+            if (curr->key == key) {
+                node->value = value;
+                return newroot;
+            }
+            link = key < curr->key ? &node->left : &node->right;
+            curr = *link;
+        }
+        *link = create(key, value);
+        inserted = true;
+        return newroot;
+    }
+
+    static void update_count(node_type * node) {
+        node->count = std::max(height(node->left), height(node->right)) + 1;
+    }
+
+    node_type * balance_avl(node_type * node) {
+        auto diff = height(node->left) - height(node->right);
+        if (diff >= 2) {
+            node->left = own(node->left);
+            if (height(node->left->left) < height(node->left->right)) {
+                node->left->right = own(node->left->right);
+                node->left = rotate_left(node->left);
+                update_count(node->left->left);
+            }
+            node = rotate_right(node);
+            update_count(node->right);
+        } else if (diff <= -2) {
+            node->right = own(node->right);
+            if (height(node->right->right) < height(node->right->left)) {
+                node->right->left = own(node->right->left);
+                node->right = rotate_right(node->right);
+                update_count(node->right->right);
+            }
+            node = rotate_left(node);
+            update_count(node->left);
+        }
+        update_count(node);
+        return node;
+    }
+
+    node_type * insert_avl(node_type * node, const key_type &key, const value_type &value, bool &inserted) {
+        if (node == nullptr) {
+            inserted = true;
+            return create(key, value);
+        }
+        node = own(node);
+        if (key < node->key) node->left = insert_avl(node->left, key, value, inserted);
+        else if (node->key < key) node->right = insert_avl(node->right, key, value, inserted);
+        else {
+            node->value = value;
+            return node;
+        }
+        return balance_avl(node);
+    }
+
+    // Red black insert in functional style, each red-red pattern below a
+    // black node is rebuilt as red parent with two black children.
+    node_type * balance_red_black(node_type * node) {
+        if (node->red) return node;
+        if (is_red(node->left)) {
+            if (is_red(node->left->left)) {
+                node->left = own(node->left);
+                node->left->left = own(node->left->left);
+                auto top = rotate_right(node);
+                top->left->red = false;
+                top->right->red = false;
+                top->red = true;
+                return top;
+            }
+            if (is_red(node->left->right)) {
+                node->left = own(node->left);
+                node->left->right = own(node->left->right);
+                node->left = rotate_left(node->left);
+                auto top = rotate_right(node);
+                top->left->red = false;
+                top->right->red = false;
+                top->red = true;
+                return top;
+            }
+        }
+        if (is_red(node->right)) {
+            if (is_red(node->right->right)) {
+                node->right = own(node->right);
+                node->right->right = own(node->right->right);
+                auto top = rotate_left(node);
+                top->left->red = false;
+                top->right->red = false;
+                top->red = true;
+                return top;
+            }
+            if (is_red(node->right->left)) {
+                node->right = own(node->right);
+                node->right->left = own(node->right->left);
+                node->right = rotate_right(node->right);
+                auto top = rotate_left(node);
+                top->left->red = false;
+                top->right->red = false;
+                top->red = true;
+                return top;
+            }
+        }
+        return node;
+    }
+
+    node_type * insert_red_black(node_type * node, const key_type &key, const value_type &value, bool &inserted) {
+        if (node == nullptr) {
+            inserted = true;
+            return create(key, value);
+        }
+        node = own(node);
+        if (key < node->key) node->left = insert_red_black(node->left, key, value, inserted);
+        else if (node->key < key) node->right = insert_red_black(node->right, key, value, inserted);
+        else {
+            node->value = value;
+            return node;
+        }
+        return balance_red_black(node);
+    }
+
+    // Same steps as bst<red_black_leftleaning> with copy before every change
+    node_type * insert_leftleaning(node_type * node, const key_type &key, const value_type &value, bool &inserted) {
+        if (node == nullptr) {
+            inserted = true;
+            return create(key, value);
+        }
+        node = own(node);
+        if (key < node->key) node->left = insert_leftleaning(node->left, key, value, inserted);
+        else if (node->key < key) node->right = insert_leftleaning(node->right, key, value, inserted);
+        else node->value = value;
+
+        if (is_red(node->right) && !is_red(node->left)) {
+            node->right = own(node->right);
+            auto top = rotate_left(node);
+            top->red = node->red;
+            node->red = true;
+            node = top;
+        }
+        if (is_red(node->left) && is_red(node->left->left)) {
+            node->left = own(node->left);
+            auto top = rotate_right(node);
+            top->red = node->red;
+            node->red = true;
+            node = top;
+        }
+        if (is_red(node->left) && is_red(node->right)) {
+            node->left = own(node->left);
+            node->right = own(node->right);
+            node->red = !node->red;
+            node->left->red = !node->left->red;
+            node->right->red = !node->right->red;
+        }
+        return node;
+    }
+
+    // Caller must be inside an epoch
+    const node_type * find_node(const key_type &key) const {
+        auto curr = root.load(std::memory_order_acquire);
+        while(curr) {
+            if (curr->key == key) return curr;
+            curr = key < curr->key ? curr->left : curr->right;
+        }
+        return nullptr;
+    }
+
+public:
+    concurrent_bst() { }
+    concurrent_bst(const concurrent_bst &) = delete;
+    concurrent_bst &operator=(const concurrent_bst &) = delete;
+
+    // No reader or writer may be active, nodes are freed right away
+    ~concurrent_bst() {
+        auto curr = root.load(std::memory_order_relaxed);
+        while(curr) {
+            if (curr->left != nullptr) {
+                auto left = curr->left;
+                curr->left = left->right;
+                left->right = curr;
+                curr = left;
+            } else {
+                auto right = curr->right;
+                delete curr;
+                curr = right;
+            }
+        }
+    }
+
+    // Duplicate will be overridden. Writers are serialised among themselves
+    // and never block readers.
+    void insert(const key_type &key, const value_type &value) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        auto oldroot = root.load(std::memory_order_relaxed);
+        bool inserted = false;
+        node_type *newroot;
+        ++generation;
+        try {
+            if constexpr (impl == blancing_type::none) {
+                newroot = insert_none(oldroot, key, value, inserted);
+            } else if constexpr (impl == blancing_type::avl) {
+                newroot = insert_avl(oldroot, key, value, inserted);
+            } else if constexpr (impl == blancing_type::red_black) {
+                newroot = insert_red_black(oldroot, key, value, inserted);
+                newroot->red = false;
+            } else {
+                newroot = insert_leftleaning(oldroot, key, value, inserted);
+                newroot->red = false;
+            }
+        } catch(...) {
+            rollback();
+            throw;
+        }
+
+        root.store(newroot, std::memory_order_release);
+        if (inserted) count.fetch_add(1, std::memory_order_relaxed);
+
+        // Whole path copied by this insert is retired under one lock
+        epoch_domain::global().retire(std::span<node_type * const>(replaced));
+        fresh.clear();
+        replaced.clear();
+    }
+
+    // end() if key is not present, see iterator
+    iterator find(const key_type &key) const {
+        epoch_guard guard;
+        return iterator(find_node(key));
+    }
+
+    iterator end() const {
+        return iterator();
+    }
+
+    bool contains(const key_type &key) const {
+        epoch_guard guard;
+        return find_node(key) != nullptr;
+    }
+
+    size_t size() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+}; // class concurrent_bst
+
+} // namespace rohit
@@ -0,0 +1,380 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <tries.hh>
+#include <epoch.hh>
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace rohit {
+
+// Read mostly tries for many writer threads. Keys are spread over shard_count
+// independent tries by hash of whole key, each with its own writer mutex, so
+// writers only wait for writers of same shard. Reader takes no lock: it walks
+// inside an epoch. A node holds its value, a compressed prefix and its
+// children with spare slots, so header, keys and child slot of a step are
+// one or two cache lines. Writer appends a child into next free slot and
+// publishes it with a release store of count. A full node, or one whose
+// prefix must be cut, is copied and swapped into its parent slot, old copy
+// is retired to epoch_domain. A chain ending in a key is one node with a
+// prefix until another key leaves it (lazy expansion). There is no erase.
+// Values are kept in atomics, so value_type must be trivially copyable. Same
+// as tries, a key is present when its value is not default_value.
+template <typename key_type, typename value_type = bool, size_t shard_count = 64>
+    requires std::is_trivially_copyable_v<value_type> && (shard_count > 0)
+class concurrent_tries {
+public:
+    using key_char_type = key_type::value_type;
+    using key_view_type = std::basic_string_view<key_char_type>;
+
+    // Header followed by capacity key characters in order of insertion,
+    // prefix characters, then capacity child slots. Key slots below count
+    // are never modified once published, a child slot only changes to a copy
+    // of same child. One allocation, freed as a whole.
+    struct node_type {
+        std::atomic<value_type> value;
+        uint32_t capacity;
+        uint32_t prefix;                // Characters every child key starts with
+        std::atomic<uint32_t> count;
+
+        static size_t children_offset(size_t capacity, size_t prefix) {
+            auto offset = sizeof(node_type) + (capacity + prefix) * sizeof(key_char_type);
+            constexpr auto alignment = alignof(std::atomic<node_type *>);
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        key_char_type * keys() {
+            return reinterpret_cast<key_char_type *>(this + 1);
+        }
+
+        key_view_type prefix_view() {
+            return { keys() + capacity, prefix };
+        }
+
+        std::atomic<node_type *> * children() {
+            return reinterpret_cast<std::atomic<node_type *> *>(reinterpret_cast<char *>(this) + children_offset(capacity, prefix));
+        }
+
+        static node_type * create(value_type value, size_t capacity, key_view_type prefix) {
+            auto memory = ::operator new(children_offset(capacity, prefix.size()) + capacity * sizeof(std::atomic<node_type *>));
+            auto node = new(memory) node_type { value, static_cast<uint32_t>(capacity), static_cast<uint32_t>(prefix.size()), 0 };
+            std::copy(prefix.begin(), prefix.end(), node->keys() + capacity);
+            return node;
+        }
+
+        // Matches create, epoch_domain frees a retired node with delete
+        static void operator delete(void *memory) {
+            ::operator delete(memory);
+        }
+
+        // Slot of child for key_char, nullptr when missing
+        std::atomic<node_type *> * find(key_char_type key_char) {
+            auto first = keys();
+            auto last = first + count.load(std::memory_order_acquire);
+            auto position = std::find(first, last, key_char);
+            if (position == last) return nullptr;
+            return children() + (position - first);
+        }
+
+        // Writer only, a free slot must be left
+        void append(key_char_type key_char, node_type *child) {
+            auto position = count.load(std::memory_order_relaxed);
+            assert(position < capacity);
+            children()[position].store(child, std::memory_order_relaxed);
+            keys()[position] = key_char;
+            count.store(position + 1, std::memory_order_release);
+        }
+    };
+
+    // Node of a key, keeps calling thread inside an epoch while it points to
+    // a node, so node stays readable after a writer replaces it. Value is
+    // read with a load and may lag a value stored after node was replaced.
+    class iterator {
+        const node_type *node = nullptr;
+
+        friend class concurrent_tries;
+
+        explicit iterator(const node_type *node) : node(node) {
+            if (node) epoch_domain::global().enter();
+        }
+
+    public:
+        iterator() { }
+        iterator(const iterator &other) : iterator(other.node) { }
+        iterator(iterator &&other) noexcept : node(std::exchange(other.node, nullptr)) { }
+
+        iterator &operator=(iterator other) noexcept {
+            std::swap(node, other.node);
+            return *this;
+        }
+
+        ~iterator() {
+            if (node) epoch_domain::global().leave();
+        }
+
+        const node_type &operator*() const { return *node; }
+        const node_type *operator->() const { return node; }
+
+        bool operator==(const iterator &other) const { return node == other.node; }
+    };
+
+private:
+    // Capacity given to a node when a chain turns into a branch
+    static constexpr size_t initial_capacity = 4;
+    // Replaced nodes of a shard handed to epoch_domain at once
+    static constexpr size_t retire_batch = 64;
+
+    struct alignas(64) shard_type {
+        std::mutex write_mutex;
+        std::atomic<size_t> count { 0 };
+        std::atomic<node_type *> root { nullptr };
+        std::vector<node_type *> replaced;
+    };
+
+    // Readers only touch atomics, mutable so that search can stay const
+    mutable shard_type shards[shard_count];
+
+    shard_type & shard(key_view_type key) const {
+        return shards[std::hash<key_view_type> { }(key) % shard_count];
+    }
+
+    // Reader side, caller must be inside an epoch. A key ending inside or
+    // right after a prefix has no node.
+    static node_type * walk(node_type *node, key_view_type key) {
+        for(size_t position = 0; node != nullptr && position < key.size(); ++position) {
+            if (node->prefix != 0) {
+                // Short prefixes compared in place, a call to memcmp costs more
+                auto prefix = node->prefix_view();
+                if (key.size() - position <= prefix.size()) return nullptr;
+                for(auto key_char: prefix) {
+                    if (key[position++] != key_char) return nullptr;
+                }
+            }
+            auto slot = node->find(key[position]);
+            if (slot == nullptr) return nullptr;
+            node = slot->load(std::memory_order_acquire);
+        }
+        return node;
+    }
+
+    // Writer side below, requires write_mutex of shard owning node. Every new
+    // node is complete before it is published. Only this writer can retire
+    // nodes of its shard, so it needs no epoch of its own, and it holds
+    // replaced nodes back to retire a batch under one lock of epoch_domain.
+    static void replace(shard_type &current, std::atomic<node_type *> *link, node_type *previous, node_type *next) {
+        if (previous != nullptr) current.replaced.reserve(retire_batch);
+        link->store(next, std::memory_order_release);
+        if (previous == nullptr) return;
+        current.replaced.push_back(previous);
+        if (current.replaced.size() == retire_batch) {
+            epoch_domain::global().retire(std::span<node_type * const>(current.replaced));
+            current.replaced.clear();
+        }
+    }
+
+    // Copy of node with its children, prefix without first skip characters
+    static node_type * copy(node_type *node, value_type value, size_t capacity, size_t skip) {
+        auto count = node->count.load(std::memory_order_relaxed);
+        auto next = node_type::create(value, capacity, node->prefix_view().substr(skip));
+        for(size_t index = 0; index < count; ++index) {
+            next->children()[index].store(node->children()[index].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        std::copy(node->keys(), node->keys() + count, next->keys());
+        next->count.store(count, std::memory_order_relaxed);
+        return next;
+    }
+
+    // Node holding value with a chain for suffix below it, suffix is not
+    // empty. Returns chain head and leaf of suffix.
+    static std::pair<node_type *, node_type *> chain(value_type value, key_view_type suffix) {
+        std::unique_ptr<node_type> head(node_type::create(value, 1, suffix.substr(0, suffix.size() - 1)));
+        auto leaf = node_type::create(default_value<value_type>::value, 0, { });
+        head->append(suffix.back(), leaf);
+        return { head.release(), leaf };
+    }
+
+    // Prefix of node is cut after length characters, rest of prefix and
+    // children move to a new child. Readers of old node still reach same
+    // children.
+    static void expand(shard_type &current, std::atomic<node_type *> *link, node_type *node, size_t length) {
+        auto prefix = node->prefix_view();
+        std::unique_ptr<node_type> rest(copy(node, default_value<value_type>::value, node->capacity, length + 1));
+        auto next = node_type::create(node->value.load(std::memory_order_relaxed), initial_capacity, prefix.substr(0, length));
+        next->append(prefix[length], rest.release());
+        replace(current, link, node, next);
+    }
+
+    // New child of node for suffix, a full node is copied into a larger one.
+    // Returns node of whole key.
+    static node_type * add_child(shard_type &current, std::atomic<node_type *> *link, node_type *node, key_view_type suffix) {
+        node_type *head, *leaf;
+        if (suffix.size() == 1) head = leaf = node_type::create(default_value<value_type>::value, 0, { });
+        else std::tie(head, leaf) = chain(default_value<value_type>::value, suffix.substr(1));
+        std::unique_ptr<node_type> created(head);
+        if (node->count.load(std::memory_order_relaxed) == node->capacity) {
+            std::unique_ptr<node_type> next(copy(node, node->value.load(std::memory_order_relaxed), std::max(initial_capacity, 2 * size_t { node->capacity }), 0));
+            next->append(suffix[0], created.release());
+            replace(current, link, node, next.release());
+        } else {
+            node->append(suffix[0], created.release());
+        }
+        return leaf;
+    }
+
+    // Node of key, built when missing
+    static node_type * locate(shard_type &current, key_view_type key) {
+        auto link = &current.root;
+        size_t position = 0;
+        while(true) {
+            auto node = link->load(std::memory_order_relaxed);
+            auto rest = key.substr(position);
+            if (node == nullptr) {
+                if (rest.empty()) {
+                    node = node_type::create(default_value<value_type>::value, 0, { });
+                    replace(current, link, nullptr, node);
+                    return node;
+                }
+                auto [head, leaf] = chain(default_value<value_type>::value, rest);
+                replace(current, link, nullptr, head);
+                return leaf;
+            }
+            if (rest.empty()) return node;
+            if (node->count.load(std::memory_order_relaxed) == 0) {
+                // Node without children takes chain of rest, keeping its value
+                auto [head, leaf] = chain(node->value.load(std::memory_order_relaxed), rest);
+                replace(current, link, node, head);
+                return leaf;
+            }
+            auto prefix = node->prefix_view();
+            auto common = static_cast<size_t>(std::mismatch(prefix.begin(), prefix.end(), rest.begin(), rest.end()).first - prefix.begin());
+            if (common == rest.size()) {
+                // Key ends inside or right after prefix, its node is made one
+                // character earlier and found as a child below
+                expand(current, link, node, common - 1);
+                continue;
+            }
+            if (common < prefix.size()) {
+                expand(current, link, node, common);
+                continue;
+            }
+            position += prefix.size();
+            auto slot = node->find(key[position]);
+            if (slot == nullptr) return add_child(current, link, node, key.substr(position));
+            link = slot;
+            ++position;
+        }
+    }
+
+    // Every node below root and root itself
+    static void free_nodes(node_type *root) {
+        std::vector<node_type *> pending;
+        if (root) pending.push_back(root);
+        while(!pending.empty()) {
+            auto node = pending.back();
+            pending.pop_back();
+            auto count = node->count.load(std::memory_order_relaxed);
+            for(size_t index = 0; index < count; ++index) {
+                pending.push_back(node->children()[index].load(std::memory_order_relaxed));
+            }
+            delete node;
+        }
+    }
+
+public:
+    concurrent_tries() { }
+    concurrent_tries(const concurrent_tries &) = delete;
+    concurrent_tries &operator=(const concurrent_tries &) = delete;
+
+    // No reader or writer may be active, nodes are freed right away
+    ~concurrent_tries() {
+        for(auto &current: shards) {
+            free_nodes(current.root.load(std::memory_order_relaxed));
+            for(auto node: current.replaced) delete node;
+        }
+    }
+
+    // Existing value is overridden. Writers of different shards never wait
+    // for each other, no writer blocks a reader.
+    void insert(key_view_type key, const value_type &value) {
+        auto &current = shard(key);
+        std::lock_guard<std::mutex> lock(current.write_mutex);
+        auto node = locate(current, key);
+        // Only this writer stores value and count, no read-modify-write needed
+        auto previous = node->value.load(std::memory_order_relaxed);
+        node->value.store(value, std::memory_order_release);
+        bool was_present = previous != default_value<value_type>::value;
+        bool present = value != default_value<value_type>::value;
+        if (present != was_present) {
+            auto count = current.count.load(std::memory_order_relaxed);
+            current.count.store(present ? count + 1 : count - 1, std::memory_order_relaxed);
+        }
+    }
+
+    // Set of keys, same as tries_set
+    void insert(key_view_type key) requires std::same_as<value_type, bool> {
+        insert(key, true);
+    }
+
+    // Node of key or end(), same as tries a node with default value is not
+    // a key
+    iterator search(key_view_type key) const {
+        epoch_guard guard;
+        return iterator(walk(shard(key).root.load(std::memory_order_acquire), key));
+    }
+
+    iterator end() const {
+        return iterator();
+    }
+
+    bool contains(key_view_type key) const {
+        epoch_guard guard;
+        auto node = walk(shard(key).root.load(std::memory_order_acquire), key);
+        return node != nullptr && node->value.load(std::memory_order_acquire) != default_value<value_type>::value;
+    }
+
+    // Sum over shards, exact only while no insert is running
+    size_t size() const {
+        size_t result = 0;
+        for(auto &current: shards) {
+            result += current.count.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+}; // class concurrent_tries
+
+// Set of keys, value is presence flag
+template <typename key_type, size_t shard_count = 64>
+using concurrent_tries_set = concurrent_tries<key_type, bool, shard_count>;
+
+} // namespace rohit
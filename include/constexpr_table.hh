@@ -0,0 +1,112 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace rohit {
+
+// Key as stored in a compile time table, string literals are kept as
+// std::string_view so that they compare by content
+template <typename entry_key_type>
+struct constexpr_key {
+    using type = std::conditional_t<std::is_convertible_v<entry_key_type, std::string_view>, std::string_view, entry_key_type>;
+};
+
+template <typename key_char_type, typename traits_type>
+struct constexpr_key<std::basic_string_view<key_char_type, traits_type>> {
+    using type = std::basic_string_view<key_char_type, traits_type>;
+};
+
+// Entry of a compile time table is either a key, which maps to true, or a
+// std::pair of key and value
+template <typename entry_type>
+struct constexpr_entry {
+    using key_type = constexpr_key<entry_type>::type;
+    using value_type = bool;
+    static constexpr key_type key(const entry_type &entry) { return key_type(entry); }
+    static constexpr value_type value(const entry_type &) { return true; }
+};
+
+template <typename first_type, typename second_type>
+struct constexpr_entry<std::pair<first_type, second_type>> {
+    using key_type = constexpr_key<first_type>::type;
+    using value_type = second_type;
+    static constexpr key_type key(const std::pair<first_type, second_type> &entry) { return key_type(entry.first); }
+    static constexpr value_type value(const std::pair<first_type, second_type> &entry) { return entry.second; }
+};
+
+// Either a built in array or std::array
+template <typename table_type>
+consteval size_t constexpr_size() {
+    if constexpr (std::is_array_v<table_type>) return std::extent_v<table_type>;
+    else return std::tuple_size_v<table_type>;
+}
+
+template <typename table_type>
+using constexpr_entry_of = constexpr_entry<std::remove_cvref_t<decltype(std::declval<const table_type &>()[0])>>;
+
+// Positions of entries ordered by key, equal keys in input order
+template <typename table_type>
+constexpr auto constexpr_order(const table_type &entries) {
+    using entry = constexpr_entry_of<table_type>;
+    std::array<size_t, constexpr_size<table_type>()> order { };
+    for(size_t index = 0; index < order.size(); ++index) order[index] = index;
+    std::sort(order.begin(), order.end(), [&entries](size_t lhs, size_t rhs) {
+        auto lhs_key = entry::key(entries[lhs]);
+        auto rhs_key = entry::key(entries[rhs]);
+        if (lhs_key < rhs_key) return true;
+        if (rhs_key < lhs_key) return false;
+        return lhs < rhs;
+    });
+    return order;
+}
+
+template <typename table_type>
+constexpr size_t constexpr_distinct(const table_type &entries) {
+    using entry = constexpr_entry_of<table_type>;
+    auto order = constexpr_order(entries);
+    size_t count = 0;
+    for(size_t index = 0; index < order.size(); ++index) {
+        if (index == 0 || entry::key(entries[order[index - 1]]) < entry::key(entries[order[index]])) ++count;
+    }
+    return count;
+}
+
+// Sorted unique key value pairs, for duplicate key last one wins same as
+// insert into a bst. count must be constexpr_distinct(entries).
+template <size_t count, typename table_type>
+constexpr auto constexpr_sorted_unique(const table_type &entries) {
+    using entry = constexpr_entry_of<table_type>;
+    auto order = constexpr_order(entries);
+    std::array<std::pair<typename entry::key_type, typename entry::value_type>, count> result { };
+    size_t out = 0;
+    for(size_t index = 0; index < order.size(); ++index) {
+        auto &current = entries[order[index]];
+        if (index + 1 < order.size() && !(entry::key(current) < entry::key(entries[order[index + 1]]))) continue;
+        result[out++] = { entry::key(current), entry::value(current) };
+    }
+    return result;
+}
+
+} // namespace rohit
@@ -0,0 +1,198 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace rohit {
+
+// Epoch based reclamation shared by all concurrent containers.
+// Reader announces global epoch in its own slot for the duration of a read
+// (plain store followed by a fence, no read-modify-write). Writer retires
+// unlinked memory with current epoch, memory is freed once every active
+// reader has announced a later epoch.
+class epoch_domain {
+public:
+    static constexpr size_t max_threads = 512;
+    static constexpr uint64_t quiescent = std::numeric_limits<uint64_t>::max();
+
+private:
+    struct alignas(64) slot {
+        std::atomic<uint64_t> epoch { quiescent };
+        std::atomic<bool> used { false };
+    };
+
+    struct retired {
+        uint64_t epoch;
+        void *ptr;
+        void (*deleter)(void *);
+    };
+
+    // Reclaim is attempted once this many objects are waiting
+    static constexpr size_t reclaim_threshold = 1024;
+
+    slot slots[max_threads];
+    std::atomic<size_t> slot_limit { 0 };
+    std::atomic<uint64_t> global_epoch { 1 };
+
+    std::mutex retire_mutex;
+    std::vector<retired> retired_list;
+
+    // Each thread keeps one slot for its lifetime, released on thread exit
+    struct thread_slot {
+        slot *current = nullptr;
+        size_t nesting = 0;
+
+        ~thread_slot() {
+            if (current) {
+                current->epoch.store(quiescent, std::memory_order_release);
+                current->used.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    static thread_slot &local() {
+        static thread_local thread_slot result;
+        return result;
+    }
+
+    slot *acquire_slot() {
+        for(size_t index = 0; index < max_threads; ++index) {
+            bool expected = false;
+            if (!slots[index].used.load(std::memory_order_relaxed) &&
+                slots[index].used.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                auto limit = slot_limit.load(std::memory_order_relaxed);
+                while(limit <= index && !slot_limit.compare_exchange_weak(limit, index + 1)) { }
+                return &slots[index];
+            }
+        }
+        throw std::length_error("epoch_domain: too many threads");
+    }
+
+    // Requires retire_mutex
+    void reclaim_locked() {
+        global_epoch.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto oldest = quiescent;
+        auto limit = slot_limit.load(std::memory_order_acquire);
+        for(size_t index = 0; index < limit; ++index) {
+            auto epoch = slots[index].epoch.load(std::memory_order_acquire);
+            if (epoch < oldest) oldest = epoch;
+        }
+
+        auto out = retired_list.begin();
+        for(auto itr = retired_list.begin(); itr != retired_list.end(); ++itr) {
+            if (itr->epoch < oldest) {
+                itr->deleter(itr->ptr);
+            } else {
+                *out++ = *itr;
+            }
+        }
+        retired_list.erase(out, retired_list.end());
+    }
+
+    // Per thread slot cache assumes a single domain, see global()
+    epoch_domain() { }
+
+public:
+    epoch_domain(const epoch_domain &) = delete;
+    epoch_domain &operator=(const epoch_domain &) = delete;
+
+    // No reader can be active once domain itself is going away
+    ~epoch_domain() {
+        for(auto &item: retired_list) {
+            item.deleter(item.ptr);
+        }
+    }
+
+    static epoch_domain &global() {
+        static epoch_domain domain;
+        return domain;
+    }
+
+    void enter() {
+        auto &current = local();
+        if (current.nesting++ != 0) return;
+        if (current.current == nullptr) current.current = acquire_slot();
+        current.current->epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // Announcement must be visible before any shared pointer is read
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void leave() {
+        auto &current = local();
+        assert(current.nesting > 0);
+        if (--current.nesting != 0) return;
+        current.current->epoch.store(quiescent, std::memory_order_release);
+    }
+
+    // ptr must already be unreachable for new readers
+    template <typename type>
+    void retire(type *ptr) {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        retired_list.push_back({ global_epoch.load(std::memory_order_acquire), ptr, [](void *obj) { delete static_cast<type *>(obj); } });
+        if (retired_list.size() >= reclaim_threshold) reclaim_locked();
+    }
+
+    // Every pointer of ptrs under one lock, for writers which collect
+    // unlinked memory first
+    template <typename type>
+    void retire(std::span<type * const> ptrs) {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        auto epoch = global_epoch.load(std::memory_order_acquire);
+        for(auto ptr: ptrs) {
+            retired_list.push_back({ epoch, ptr, [](void *obj) { delete static_cast<type *>(obj); } });
+        }
+        if (retired_list.size() >= reclaim_threshold) reclaim_locked();
+    }
+
+    void reclaim() {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        reclaim_locked();
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        return retired_list.size();
+    }
+}; // class epoch_domain
+
+// Keeps current thread inside a read side critical section
+class epoch_guard {
+    epoch_domain &domain;
+
+public:
+    epoch_guard() : domain(epoch_domain::global()) {
+        domain.enter();
+    }
+
+    epoch_guard(const epoch_guard &) = delete;
+    epoch_guard &operator=(const epoch_guard &) = delete;
+
+    ~epoch_guard() {
+        domain.leave();
+    }
+}; // class epoch_guard
+
+} // namespace rohit
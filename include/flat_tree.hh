@@ -0,0 +1,303 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <tree.hh>
+#include <tree_traversal.hh>
+#include <mapped_file.hh>
+#include <constexpr_table.hh>
+#include <assert.h>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace rohit {
+
+enum class flat_layout {
+    eytzinger,      // BFS order, children of k are 2k and 2k + 1
+    van_emde_boas   // Recursive top and bottom half blocks, cache oblivious
+};
+
+template <typename key_type, typename value_type>
+struct flat_node {
+    key_type key;
+    value_type value;
+};
+
+// Immutable search tree with implicit children kept in one array. Build input
+// is sorted unique key value pairs, same as inorder() output of a bst.
+// Node array is pointer free, save() writes it as it is and open() searches a
+// read only mapping of the file without copying.
+template <typename key_type, typename value_type, flat_layout layout = flat_layout::eytzinger>
+    requires std::totally_ordered<key_type>
+class flat_bst {
+public:
+    using node_type = flat_node<key_type, value_type>;
+
+private:
+    // Nodes four levels below are 16 consecutive entries in eytzinger order
+    static constexpr size_t prefetch_distance = 16;
+    static constexpr size_t max_height = 64;
+
+    std::vector<node_type> nodes;   // Empty for a tree opened from file
+    std::span<const node_type> view;  // nodes or section of mapping
+    mapped_file mapping;
+    size_t count = 0;
+
+    // van Emde Boas order is kept on a complete tree. For every depth d which
+    // is root of a bottom tree, anchor[d] is depth of the enclosing recursive
+    // subtree root, top_size[d] its top tree size and bottom_size[d] the size
+    // of each bottom tree.
+    size_t height = 0;
+    uint8_t anchor[max_height] { };
+    size_t top_size[max_height] { };
+    size_t bottom_size[max_height] { };
+
+    void eytzinger_order(std::vector<size_t> &order, size_t &rank, size_t k) {
+        if (k > count) return;
+        eytzinger_order(order, rank, 2 * k);
+        order[k - 1] = rank++;
+        eytzinger_order(order, rank, 2 * k + 1);
+    }
+
+    void veb_tables(size_t root_depth, size_t subtree_height) {
+        if (subtree_height <= 1) return;
+        auto top = subtree_height / 2;
+        auto bottom = subtree_height - top;
+        auto depth = root_depth + top;
+        anchor[depth] = static_cast<uint8_t>(root_depth);
+        top_size[depth] = (size_t { 1 } << top) - 1;
+        bottom_size[depth] = (size_t { 1 } << bottom) - 1;
+        veb_tables(root_depth, top);
+        veb_tables(depth, bottom);
+    }
+
+    // Position of BFS index k at depth given position of its anchor ancestor
+    size_t veb_position(size_t k, size_t depth, size_t anchor_position) const {
+        auto shift = depth - anchor[depth];
+        return anchor_position + top_size[depth] + (k & ((size_t { 1 } << shift) - 1)) * bottom_size[depth];
+    }
+
+    template <typename pair_type>
+    void build(const std::vector<pair_type> &sorted) {
+        count = sorted.size();
+        if (count == 0) return;
+
+        if constexpr (layout == flat_layout::eytzinger) {
+            std::vector<size_t> order(count);
+            size_t rank = 0;
+            eytzinger_order(order, rank, 1);
+            nodes.reserve(count);
+            for(auto index: order) {
+                nodes.push_back({ sorted[index].first, sorted[index].second });
+            }
+        } else {
+            // Padded to complete tree, padding repeats the largest pair so that
+            // in order sequence stays sorted
+            height = std::bit_width(count);
+            assert(height < max_height);
+            veb_tables(0, height);
+            size_t total = (size_t { 1 } << height) - 1;
+            std::vector<size_t> position(total + 1);
+            std::vector<size_t> order(total);
+            for(size_t k = 1; k <= total; ++k) {
+                size_t depth = std::bit_width(k) - 1;
+                if (depth == 0) position[k] = 0;
+                else position[k] = veb_position(k, depth, position[k >> (depth - anchor[depth])]);
+                size_t rank = (k - (size_t { 1 } << depth)) * (size_t { 1 } << (height - depth)) + (size_t { 1 } << (height - depth - 1)) - 1;
+                order[position[k]] = std::min(rank, count - 1);
+            }
+            nodes.reserve(total);
+            for(auto index: order) {
+                nodes.push_back({ sorted[index].first, sorted[index].second });
+            }
+        }
+        view = nodes;
+    }
+
+    static constexpr file_format format = layout == flat_layout::eytzinger ? file_format::flat_bst_eytzinger : file_format::flat_bst_van_emde_boas;
+
+    const node_type * find_eytzinger(const key_type &key) const {
+        auto base = view.data();
+        size_t k = 1;
+        while(k <= count) {
+            if (prefetch_distance * k <= count) __builtin_prefetch(base + prefetch_distance * k - 1);
+            k = 2 * k + (base[k - 1].key < key);
+        }
+        // Undo right turns taken after last left turn, that node is lower bound
+        k >>= std::countr_one(k) + 1;
+        if (k == 0 || !(base[k - 1].key == key)) return nullptr;
+        return base + k - 1;
+    }
+
+    const node_type * find_van_emde_boas(const key_type &key) const {
+        auto base = view.data();
+        size_t position[max_height];
+        size_t candidate = view.size();
+        size_t k = 1;
+        for(size_t depth = 0; depth < height; ++depth) {
+            position[depth] = depth == 0 ? 0 : veb_position(k, depth, position[anchor[depth]]);
+            bool less = base[position[depth]].key < key;
+            candidate = less ? candidate : position[depth];
+            k = 2 * k + less;
+        }
+        if (candidate == view.size() || !(base[candidate].key == key)) return nullptr;
+        return base + candidate;
+    }
+
+public:
+    flat_bst() { }
+
+    template <typename pair_type>
+    explicit flat_bst(const std::vector<pair_type> &sorted) {
+        build(sorted);
+    }
+
+    flat_bst(const flat_bst &) = delete;
+    flat_bst &operator=(const flat_bst &) = delete;
+    // Moving vector keeps its buffer, so view stays valid
+    flat_bst(flat_bst &&) = default;
+    flat_bst &operator=(flat_bst &&) = default;
+
+    // Writes tree to path, replacing any existing file. Height is kept so
+    // that van Emde Boas tables can be rebuilt on open.
+    void save(const std::string &path) const
+        requires std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type>
+    {
+        auto header = file_header::make(format, sizeof(key_type), sizeof(value_type), count, height);
+        write_sections(path, header, { std::as_bytes(view) });
+    }
+
+    // Tree saved by save() with same layout, searched in place. Throws
+    // std::system_error if file cannot be mapped or does not match.
+    static flat_bst open(const std::string &path)
+        requires std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type>
+    {
+        flat_bst result;
+        result.mapping = mapped_file(path);
+        auto &header = read_header(result.mapping, format, sizeof(key_type), sizeof(value_type));
+        result.view = read_section<node_type>(result.mapping, header, 0);
+        result.count = header.count;
+        bool valid;
+        if constexpr (layout == flat_layout::eytzinger) {
+            valid = result.view.size() == result.count;
+        } else {
+            result.height = header.parameter;
+            valid = result.height < max_height &&
+                result.height == static_cast<size_t>(std::bit_width(result.count)) &&
+                result.view.size() == (result.count ? (size_t { 1 } << result.height) - 1 : 0);
+            if (valid) result.veb_tables(0, result.height);
+        }
+        if (!valid) throw std::system_error(std::make_error_code(std::errc::invalid_argument), "flat_bst: inconsistent file");
+        return result;
+    }
+
+    const node_type * find(const key_type &key) const {
+        if constexpr (layout == flat_layout::eytzinger) return find_eytzinger(key);
+        else return find_van_emde_boas(key);
+    }
+
+    const node_type * end() const {
+        return nullptr;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+}; // class flat_bst
+
+// Read only snapshot of a bst
+template <flat_layout layout = flat_layout::eytzinger, typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+flat_bst<key_type, value_type, layout> freeze(bst<key_type, value_type, impl, augment_type, allocator_type> &tree) {
+    return flat_bst<key_type, value_type, layout>(inorder(tree));
+}
+
+// Saves snapshot of a bst, flat_bst<key_type, value_type, layout>::open()
+// loads it back without rebuilding
+template <flat_layout layout = flat_layout::eytzinger, typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+void save(bst<key_type, value_type, impl, augment_type, allocator_type> &tree, const std::string &path) {
+    freeze<layout>(tree).save(path);
+}
+
+// Eytzinger ordered search tree built during compilation, count is number of
+// distinct keys. Nodes are held in the object itself, a constexpr instance is
+// placed in read only data with no heap and nothing to run at startup.
+template <typename key_type, typename value_type, size_t count>
+    requires std::totally_ordered<key_type>
+class constexpr_bst {
+public:
+    using node_type = flat_node<key_type, value_type>;
+
+private:
+    std::array<node_type, count> nodes { };
+
+    template <typename pair_type>
+    constexpr void eytzinger_order(const std::array<pair_type, count> &sorted, size_t &rank, size_t k) {
+        if (k > count) return;
+        eytzinger_order(sorted, rank, 2 * k);
+        nodes[k - 1] = { sorted[rank].first, sorted[rank].second };
+        ++rank;
+        eytzinger_order(sorted, rank, 2 * k + 1);
+    }
+
+public:
+    // Table of keys or key value pairs in any order, see constexpr_entry
+    template <typename table_type>
+    constexpr explicit constexpr_bst(const table_type &entries) {
+        auto sorted = constexpr_sorted_unique<count>(entries);
+        size_t rank = 0;
+        eytzinger_order(sorted, rank, 1);
+    }
+
+    constexpr const node_type * find(const key_type &key) const {
+        size_t k = 1;
+        while(k <= count) {
+            k = 2 * k + (nodes[k - 1].key < key);
+        }
+        k >>= std::countr_one(k) + 1;
+        if (k == 0 || !(nodes[k - 1].key == key)) return nullptr;
+        return &nodes[k - 1];
+    }
+
+    constexpr const node_type * end() const {
+        return nullptr;
+    }
+
+    constexpr bool contains(const key_type &key) const {
+        return find(key) != end();
+    }
+
+    constexpr size_t size() const { return count; }
+    constexpr bool empty() const { return count == 0; }
+
+}; // class constexpr_bst
+
+// constexpr_bst of a table with static storage, for example
+//   static constexpr int values[] = { 5, 3, 8 };
+//   constexpr auto tree = make_constexpr_bst<values>();
+template <const auto &entries>
+constexpr auto make_constexpr_bst() {
+    using entry = constexpr_entry_of<std::remove_cvref_t<decltype(entries)>>;
+    return constexpr_bst<typename entry::key_type, typename entry::value_type, constexpr_distinct(entries)>(entries);
+}
+
+} // namespace rohit
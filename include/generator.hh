@@ -0,0 +1,129 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace rohit {
+
+// Lazy input range over values yielded by a coroutine, stand in for C++23
+// std::generator. Only references are yielded, so nothing is copied and the
+// coroutine frame is the only allocation.
+template <typename reference_type>
+    requires std::is_reference_v<reference_type>
+class generator {
+public:
+    struct promise_type {
+        std::add_pointer_t<reference_type> current = nullptr;
+        std::exception_ptr error;
+
+        generator get_return_object() {
+            return generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return { }; }
+        std::suspend_always final_suspend() noexcept { return { }; }
+
+        std::suspend_always yield_value(reference_type value) noexcept {
+            current = std::addressof(value);
+            return { };
+        }
+
+        void return_void() { }
+
+        void unhandled_exception() {
+            error = std::current_exception();
+        }
+
+        // Generator body may only yield
+        template <typename awaitable_type>
+        std::suspend_never await_transform(awaitable_type &&) = delete;
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    class iterator {
+        handle_type handle = nullptr;
+
+    public:
+        using value_type = std::remove_cvref_t<reference_type>;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() { }
+        explicit iterator(handle_type handle) : handle(handle) { }
+
+        reference_type operator*() const {
+            return static_cast<reference_type>(*handle.promise().current);
+        }
+
+        iterator &operator++() {
+            handle.resume();
+            if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        friend bool operator==(const iterator &itr, std::default_sentinel_t) {
+            return itr.handle.done();
+        }
+    }; // class iterator
+
+private:
+    handle_type handle = nullptr;
+
+    explicit generator(handle_type handle) : handle(handle) { }
+
+public:
+    generator(const generator &) = delete;
+    generator &operator=(const generator &) = delete;
+
+    generator(generator &&other) noexcept : handle(std::exchange(other.handle, nullptr)) { }
+
+    generator &operator=(generator &&other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~generator() {
+        if (handle) handle.destroy();
+    }
+
+    // Runs body up to first yield, may be called only once
+    iterator begin() {
+        handle.resume();
+        if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+        return iterator(handle);
+    }
+
+    std::default_sentinel_t end() {
+        return { };
+    }
+
+}; // class generator
+
+} // namespace rohit
@@ -0,0 +1,234 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rohit {
+
+[[noreturn]] inline void throw_file_error(int error, const std::string &what) {
+    throw std::system_error(error, std::generic_category(), what);
+}
+
+// Read only shared mapping of a whole file. Pages come from page cache, so
+// every process mapping same file shares one physical copy.
+class mapped_file {
+    const std::byte *address = nullptr;
+    size_t length = 0;
+
+    void release() {
+        if (address) ::munmap(const_cast<std::byte *>(address), length);
+        address = nullptr;
+        length = 0;
+    }
+
+public:
+    mapped_file() { }
+
+    explicit mapped_file(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw_file_error(errno, "mapped_file: open " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            auto error = errno;
+            ::close(fd);
+            throw_file_error(error, "mapped_file: stat " + path);
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length != 0) {
+            auto result = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            auto error = errno;
+            ::close(fd);
+            if (result == MAP_FAILED) throw_file_error(error, "mapped_file: mmap " + path);
+            address = static_cast<const std::byte *>(result);
+        } else {
+            ::close(fd);
+        }
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    mapped_file(mapped_file &&other) : address(std::exchange(other.address, nullptr)), length(std::exchange(other.length, 0)) { }
+
+    mapped_file &operator=(mapped_file &&other) {
+        if (this != &other) {
+            release();
+            address = std::exchange(other.address, nullptr);
+            length = std::exchange(other.length, 0);
+        }
+        return *this;
+    }
+
+    ~mapped_file() {
+        release();
+    }
+
+    const std::byte *data() const { return address; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+}; // class mapped_file
+
+enum class file_format : uint32_t {
+    flat_bst_eytzinger = 1,
+    flat_bst_van_emde_boas = 2,
+    static_tries = 3
+};
+
+// First 64 bytes of every saved container. Sections follow header, each one
+// starting at a multiple of section_alignment so arrays can be used in place.
+// Content is native byte order and native layout, byte_order and the element
+// sizes reject a file written by an incompatible build.
+struct file_header {
+    static constexpr char signature[8] = { 'R', 'O', 'H', 'I', 'T', 'L', 'I', 'B' };
+    static constexpr uint32_t current_version = 1;
+    static constexpr uint32_t native_byte_order = 0x01020304;
+    static constexpr size_t section_alignment = 64;
+    static constexpr size_t max_sections = 2;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    file_format format;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t parameter;     // Container specific
+    uint64_t section_size[max_sections];
+
+    static file_header make(file_format format, uint32_t key_size, uint32_t value_size, uint64_t count, uint64_t parameter = 0) {
+        file_header header { };
+        std::memcpy(header.magic, signature, sizeof(signature));
+        header.version = current_version;
+        header.byte_order = native_byte_order;
+        header.format = format;
+        header.key_size = key_size;
+        header.value_size = value_size;
+        header.count = count;
+        header.parameter = parameter;
+        return header;
+    }
+
+    static size_t aligned(size_t size) {
+        return (size + section_alignment - 1) / section_alignment * section_alignment;
+    }
+}; // struct file_header
+
+static_assert(sizeof(file_header) == file_header::section_alignment);
+
+// Writes header followed by sections. Data goes to a temporary file which is
+// renamed over path, so a reader never maps a partially written file.
+inline void write_sections(const std::string &path, file_header header, std::initializer_list<std::span<const std::byte>> sections) {
+    if (sections.size() > file_header::max_sections) throw std::system_error(std::make_error_code(std::errc::invalid_argument), "write_sections: too many sections");
+    size_t index = 0;
+    for(auto &section: sections) {
+        header.section_size[index++] = section.size();
+    }
+
+    auto temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) throw_file_error(errno, "write_sections: open " + temporary);
+
+    auto write_all = [fd, &temporary](const void *data, size_t size) {
+        auto curr = static_cast<const char *>(data);
+        while(size != 0) {
+            auto written = ::write(fd, curr, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                auto error = errno;
+                ::close(fd);
+                ::unlink(temporary.c_str());
+                throw_file_error(error, "write_sections: write " + temporary);
+            }
+            curr += written;
+            size -= static_cast<size_t>(written);
+        }
+    };
+
+    static constexpr char padding[file_header::section_alignment] { };
+    write_all(&header, sizeof(header));
+    for(auto &section: sections) {
+        write_all(section.data(), section.size());
+        write_all(padding, file_header::aligned(section.size()) - section.size());
+    }
+
+    if (::close(fd) != 0) {
+        auto error = errno;
+        ::unlink(temporary.c_str());
+        throw_file_error(error, "write_sections: close " + temporary);
+    }
+    if (::rename(temporary.c_str(), path.c_str()) != 0) {
+        auto error = errno;
+        ::unlink(temporary.c_str());
+        throw_file_error(error, "write_sections: rename " + path);
+    }
+}
+
+// Validates header of a mapped file against what caller expects
+inline const file_header &read_header(const mapped_file &file, file_format format, uint32_t key_size, uint32_t value_size) {
+    auto invalid = [](const char *what) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), what);
+    };
+    if (file.size() < sizeof(file_header)) invalid("read_header: file too small");
+    auto &header = *reinterpret_cast<const file_header *>(file.data());
+    if (std::memcmp(header.magic, file_header::signature, sizeof(file_header::signature)) != 0) invalid("read_header: bad signature");
+    if (header.version != file_header::current_version) {
+        throw std::system_error(std::make_error_code(std::errc::not_supported), "read_header: unsupported version");
+    }
+    if (header.byte_order != file_header::native_byte_order) invalid("read_header: byte order mismatch");
+    if (header.format != format) invalid("read_header: container type mismatch");
+    if (header.key_size != key_size || header.value_size != value_size) invalid("read_header: element size mismatch");
+
+    // Each section starts at aligned end of previous one
+    size_t end = sizeof(file_header);
+    for(auto size: header.section_size) {
+        if (size > file.size()) invalid("read_header: truncated file");
+        end = file_header::aligned(end) + size;
+    }
+    if (end > file.size()) invalid("read_header: truncated file");
+    return header;
+}
+
+// Section index of a validated file viewed as an array of type
+template <typename type>
+std::span<const type> read_section(const mapped_file &file, const file_header &header, size_t index) {
+    static_assert(alignof(type) <= file_header::section_alignment);
+    size_t offset = sizeof(file_header);
+    for(size_t prior = 0; prior < index; ++prior) {
+        offset += file_header::aligned(header.section_size[prior]);
+    }
+    auto size = header.section_size[index];
+    if (size % sizeof(type) != 0 || offset + size > file.size()) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "read_section: bad section size");
+    }
+    return { reinterpret_cast<const type *>(file.data() + offset), size / sizeof(type) };
+}
+
+} // namespace rohit
@@ -0,0 +1,214 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ROHIT_SIMD_X86 1
+#endif
+
+namespace rohit::simd {
+
+// Key types which have vector kernels. Everything else has supported = false
+// and callers are expected to use their generic comparison path.
+template <typename key_type>
+struct search_traits {
+    static constexpr bool supported =
+        std::is_same_v<key_type, int> || std::is_same_v<key_type, int64_t> || std::is_same_v<key_type, uint32_t> ||
+        std::is_same_v<key_type, float> || std::is_same_v<key_type, double>;
+};
+
+template <typename key_type>
+inline constexpr bool search_supported = search_traits<key_type>::supported;
+
+// All kernels take sorted keys and return number of keys less than (or equal
+// to when or_equal is set) the probe, that is lower_bound (upper_bound) index.
+template <typename key_type, bool or_equal>
+inline size_t count_scalar(const key_type *keys, size_t size, key_type key) {
+    size_t index = 0;
+    if constexpr (or_equal) {
+        while(index < size && keys[index] <= key) ++index;
+    } else {
+        while(index < size && keys[index] < key) ++index;
+    }
+    return index;
+}
+
+#ifdef ROHIT_SIMD_X86
+
+// Mask of lanes where keys[index + lane] is before the probe
+template <typename key_type, bool or_equal>
+__attribute__((target("avx2"))) inline uint32_t compare_avx2(const key_type *keys, key_type key) {
+    if constexpr (std::is_same_v<key_type, float>) {
+        auto data = _mm256_loadu_ps(keys);
+        auto probe = _mm256_set1_ps(key);
+        return _mm256_movemask_ps(_mm256_cmp_ps(data, probe, or_equal ? _CMP_LE_OQ : _CMP_LT_OQ));
+    } else if constexpr (std::is_same_v<key_type, double>) {
+        auto data = _mm256_loadu_pd(keys);
+        auto probe = _mm256_set1_pd(key);
+        return _mm256_movemask_pd(_mm256_cmp_pd(data, probe, or_equal ? _CMP_LE_OQ : _CMP_LT_OQ));
+    } else if constexpr (sizeof(key_type) == 8) {
+        auto data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys));
+        auto probe = _mm256_set1_epi64x(key);
+        // data <= probe is !(data > probe)
+        auto mask = or_equal ? _mm256_cmpgt_epi64(data, probe) : _mm256_cmpgt_epi64(probe, data);
+        auto bits = static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(mask)));
+        return or_equal ? ~bits & 0xf : bits;
+    } else {
+        auto data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys));
+        auto probe = _mm256_set1_epi32(static_cast<int32_t>(key));
+        if constexpr (std::is_unsigned_v<key_type>) {
+            // Flipping sign bit maps unsigned order onto signed order
+            auto sign = _mm256_set1_epi32(INT32_MIN);
+            data = _mm256_xor_si256(data, sign);
+            probe = _mm256_xor_si256(probe, sign);
+        }
+        auto mask = or_equal ? _mm256_cmpgt_epi32(data, probe) : _mm256_cmpgt_epi32(probe, data);
+        auto bits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+        return or_equal ? ~bits & 0xff : bits;
+    }
+}
+
+template <typename key_type, bool or_equal>
+__attribute__((target("sse4.2"))) inline uint32_t compare_sse42(const key_type *keys, key_type key) {
+    if constexpr (std::is_same_v<key_type, float>) {
+        auto data = _mm_loadu_ps(keys);
+        auto probe = _mm_set1_ps(key);
+        return _mm_movemask_ps(or_equal ? _mm_cmple_ps(data, probe) : _mm_cmplt_ps(data, probe));
+    } else if constexpr (std::is_same_v<key_type, double>) {
+        auto data = _mm_loadu_pd(keys);
+        auto probe = _mm_set1_pd(key);
+        return _mm_movemask_pd(or_equal ? _mm_cmple_pd(data, probe) : _mm_cmplt_pd(data, probe));
+    } else if constexpr (sizeof(key_type) == 8) {
+        auto data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys));
+        auto probe = _mm_set1_epi64x(key);
+        auto mask = or_equal ? _mm_cmpgt_epi64(data, probe) : _mm_cmpgt_epi64(probe, data);
+        auto bits = static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(mask)));
+        return or_equal ? ~bits & 0x3 : bits;
+    } else {
+        auto data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys));
+        auto probe = _mm_set1_epi32(static_cast<int32_t>(key));
+        if constexpr (std::is_unsigned_v<key_type>) {
+            auto sign = _mm_set1_epi32(INT32_MIN);
+            data = _mm_xor_si128(data, sign);
+            probe = _mm_xor_si128(probe, sign);
+        }
+        auto mask = or_equal ? _mm_cmpgt_epi32(data, probe) : _mm_cmpgt_epi32(probe, data);
+        auto bits = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(mask)));
+        return or_equal ? ~bits & 0xf : bits;
+    }
+}
+
+// Keys are sorted so the first block which is not entirely before the probe
+// holds the answer, no need to look further.
+template <typename key_type, bool or_equal>
+__attribute__((target("avx2"))) size_t count_avx2(const key_type *keys, size_t size, key_type key) {
+    constexpr size_t lanes = 32 / sizeof(key_type);
+    constexpr uint32_t all = (1u << lanes) - 1;
+    size_t index = 0;
+    for(; index + lanes <= size; index += lanes) {
+        auto bits = compare_avx2<key_type, or_equal>(keys + index, key);
+        if (bits != all) return index + __builtin_popcount(bits);
+    }
+    return index + count_scalar<key_type, or_equal>(keys + index, size - index, key);
+}
+
+template <typename key_type, bool or_equal>
+__attribute__((target("sse4.2"))) size_t count_sse42(const key_type *keys, size_t size, key_type key) {
+    constexpr size_t lanes = 16 / sizeof(key_type);
+    constexpr uint32_t all = (1u << lanes) - 1;
+    size_t index = 0;
+    for(; index + lanes <= size; index += lanes) {
+        auto bits = compare_sse42<key_type, or_equal>(keys + index, key);
+        if (bits != all) return index + __builtin_popcount(bits);
+    }
+    return index + count_scalar<key_type, or_equal>(keys + index, size - index, key);
+}
+
+#endif // ROHIT_SIMD_X86
+
+template <typename key_type>
+using count_function = size_t (*)(const key_type *, size_t, key_type);
+
+// Picks best kernel for this CPU, done once per key type
+template <typename key_type, bool or_equal>
+count_function<key_type> resolve_count() {
+#ifdef ROHIT_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return count_avx2<key_type, or_equal>;
+    if (__builtin_cpu_supports("sse4.2")) return count_sse42<key_type, or_equal>;
+#endif
+    return count_scalar<key_type, or_equal>;
+}
+
+// Index of first key not less than key
+template <typename key_type>
+    requires search_supported<key_type>
+size_t lower_bound(const key_type *keys, size_t size, key_type key) {
+    static const auto function = resolve_count<key_type, false>();
+    return function(keys, size, key);
+}
+
+// Index of first key greater than key
+template <typename key_type>
+    requires search_supported<key_type>
+size_t upper_bound(const key_type *keys, size_t size, key_type key) {
+    static const auto function = resolve_count<key_type, true>();
+    return function(keys, size, key);
+}
+
+// Index of first of size (at most 16) bytes equal to value, size when absent.
+// bytes must have 16 readable bytes, SSE2 is baseline on x86-64 so there is
+// no runtime dispatch here.
+inline size_t find_byte(const uint8_t *bytes, size_t size, uint8_t value) {
+#if defined(ROHIT_SIMD_X86) && defined(__SSE2__)
+    auto data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+    auto equal = _mm_cmpeq_epi8(data, _mm_set1_epi8(static_cast<char>(value)));
+    auto bits = static_cast<uint32_t>(_mm_movemask_epi8(equal)) & ((1u << size) - 1);
+    return bits ? __builtin_ctz(bits) : size;
+#else
+    for(size_t index = 0; index < size; ++index) {
+        if (bytes[index] == value) return index;
+    }
+    return size;
+#endif
+}
+
+// Same as above for size (at most 8) bytes packed into word in memory order,
+// for arrays too short for a 16 byte load. Plain integer ops, no intrinsics.
+inline size_t find_byte_word(uint64_t word, size_t size, uint8_t value) {
+    if constexpr (std::endian::native == std::endian::little) {
+        constexpr uint64_t ones = 0x0101010101010101ull;
+        auto diff = word ^ (ones * value);
+        // High bit set for every zero byte of diff. Borrow can only mark
+        // bytes after first zero byte, so lowest marked byte is exact.
+        auto zero = (diff - ones) & ~diff & (ones << 7);
+        auto index = zero ? static_cast<size_t>(std::countr_zero(zero)) / 8 : size;
+        return index < size ? index : size;
+    } else {
+        for(size_t index = 0; index < size; ++index) {
+            if (static_cast<uint8_t>(word >> (56 - 8 * index)) == value) return index;
+        }
+        return size;
+    }
+}
+
+} // namespace rohit::simd
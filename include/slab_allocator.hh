@@ -0,0 +1,305 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <assert.h>
+#include <algorithm>
+#include <cstddef>
+#include <forward_list>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace rohit {
+
+// Pool of equal sized slots carved from geometrically growing slabs. First
+// slab is small so that tiny trees stay tiny, later slabs double up to
+// max_slab_bytes. Freed slots go to an intrusive free list and are reused
+// before the slab is bumped.
+class slab_pool {
+    struct slab {
+        slab *next;
+        size_t capacity;
+    };
+
+    struct free_slot {
+        free_slot *next;
+    };
+
+    static constexpr size_t min_slab_count = 4;
+
+    size_t slot_size;
+    size_t alignment;
+    size_t header_size;
+    size_t max_slab_count;
+
+    slab *slabs = nullptr; // Newest slab first, bump pointer is always in slabs
+    free_slot *free_list = nullptr;
+    unsigned char *bump = nullptr;
+    unsigned char *bump_end = nullptr;
+
+    unsigned char *slots(slab *curr) const {
+        return reinterpret_cast<unsigned char *>(curr) + header_size;
+    }
+
+    void add_slab(size_t capacity) {
+        auto memory = ::operator new(header_size + capacity * slot_size, std::align_val_t { alignment });
+        auto newslab = static_cast<slab *>(memory);
+        newslab->next = slabs;
+        newslab->capacity = capacity;
+        slabs = newslab;
+        bump = slots(newslab);
+        bump_end = bump + capacity * slot_size;
+    }
+
+    // Remaining slots of current slab are not lost, they are moved to free list
+    void retire_bump() {
+        for(; bump != bump_end; bump += slot_size) {
+            deallocate(bump);
+        }
+    }
+
+    static size_t slot_alignment(size_t object_alignment) {
+        return std::max({ object_alignment, alignof(slab), alignof(free_slot) });
+    }
+
+    static size_t slot_bytes(size_t object_size, size_t object_alignment) {
+        auto align = slot_alignment(object_alignment);
+        return (std::max(object_size, sizeof(free_slot)) + align - 1) / align * align;
+    }
+
+public:
+    slab_pool(size_t object_size, size_t object_alignment, size_t max_slab_bytes)
+        : slot_size(slot_bytes(object_size, object_alignment)), alignment(slot_alignment(object_alignment)) {
+        header_size = (sizeof(slab) + alignment - 1) / alignment * alignment;
+        max_slab_count = std::max(min_slab_count, max_slab_bytes > header_size ? (max_slab_bytes - header_size) / slot_size : 0);
+    }
+
+    slab_pool(const slab_pool &) = delete;
+    slab_pool &operator=(const slab_pool &) = delete;
+
+    ~slab_pool() {
+        release();
+    }
+
+    bool serves(size_t object_size, size_t object_alignment) const {
+        return slot_bytes(object_size, object_alignment) == slot_size && slot_alignment(object_alignment) == alignment;
+    }
+
+    // Objects of this size and alignment fit a slot
+    size_t object_size() const { return slot_size; }
+    size_t object_alignment() const { return alignment; }
+
+    void *allocate() {
+        if (free_list) {
+            return std::exchange(free_list, free_list->next);
+        }
+
+        if (bump == bump_end) {
+            add_slab(slabs ? std::min(slabs->capacity * 2, max_slab_count) : min_slab_count);
+        }
+
+        return std::exchange(bump, bump + slot_size);
+    }
+
+    void deallocate(void *ptr) noexcept {
+        auto freed = static_cast<free_slot *>(ptr);
+        freed->next = free_list;
+        free_list = freed;
+    }
+
+    // Makes sure next count allocations come from one contiguous slab
+    void reserve(size_t count) {
+        if (static_cast<size_t>(bump_end - bump) >= count * slot_size) return;
+        retire_bump();
+        add_slab(std::max(count, min_slab_count));
+    }
+
+    // Takes over every slab and free slot of other, which must hand out slots
+    // of same size. Costs O(slabs + free slots of other).
+    void adopt(slab_pool &other) noexcept {
+        assert(other.slot_size == slot_size && other.alignment == alignment);
+        if (this == &other || other.slabs == nullptr) return;
+        other.retire_bump();
+        auto tail = other.slabs;
+        while(tail->next) tail = tail->next;
+        if (slabs) {
+            // Bump slab stays first
+            tail->next = slabs->next;
+            slabs->next = other.slabs;
+        } else {
+            tail->next = nullptr;
+            slabs = other.slabs;
+        }
+        if (other.free_list) {
+            auto free_tail = other.free_list;
+            while(free_tail->next) free_tail = free_tail->next;
+            free_tail->next = free_list;
+            free_list = other.free_list;
+        }
+        other.slabs = nullptr;
+        other.free_list = nullptr;
+        other.bump = other.bump_end = nullptr;
+    }
+
+    // Frees all slabs in O(slabs), objects are not destroyed
+    void release() noexcept {
+        while(slabs) {
+            auto next = slabs->next;
+            ::operator delete(slabs, std::align_val_t { alignment });
+            slabs = next;
+        }
+        free_list = nullptr;
+        bump = bump_end = nullptr;
+    }
+}; // class slab_pool
+
+// Pools shared by every copy and rebind of one slab_allocator, one pool per
+// slot size
+class slab_resource {
+    std::forward_list<slab_pool> pools;   // Nodes never move
+    size_t max_slab_bytes;
+
+public:
+    explicit slab_resource(size_t max_slab_bytes) : max_slab_bytes(max_slab_bytes) { }
+
+    slab_pool &pool(size_t object_size, size_t object_alignment) {
+        for(auto &curr: pools) {
+            if (curr.serves(object_size, object_alignment)) return curr;
+        }
+        return pools.emplace_front(object_size, object_alignment, max_slab_bytes);
+    }
+
+    // Every pool of other is merged into pool of same slot size
+    void adopt(slab_resource &other) {
+        for(auto &curr: other.pools) {
+            pool(curr.object_size(), curr.object_alignment()).adopt(curr);
+        }
+    }
+}; // class slab_resource
+
+// Allocator handing out single objects from a slab_pool. Resource is created
+// with the allocator, so copies and rebinds always share pools, compare equal
+// and free each other's objects as Allocator requires. Only a moved from or
+// released allocator gets a new resource on next use. Sharing is not
+// synchronised, copies must not be used from several threads at once.
+template <typename T, size_t max_slab_bytes = 64 * 1024>
+class slab_allocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = slab_allocator<U, max_slab_bytes>;
+    };
+
+private:
+    template <typename, size_t> friend class slab_allocator;
+
+    std::shared_ptr<slab_resource> resource;
+    slab_pool *pool = nullptr;  // Pool of resource serving T, found on first use
+
+    slab_pool &own_pool() {
+        if (pool == nullptr) {
+            if (!resource) resource = std::make_shared<slab_resource>(max_slab_bytes);
+            pool = &resource->pool(sizeof(T), alignof(T));
+        }
+        return *pool;
+    }
+
+public:
+    slab_allocator() : resource(std::make_shared<slab_resource>(max_slab_bytes)) { }
+
+    slab_allocator(const slab_allocator &other) noexcept
+        : resource(other.resource), pool(other.pool) { }
+
+    template <typename U>
+    slab_allocator(const slab_allocator<U, max_slab_bytes> &other) noexcept
+        : resource(other.resource) { }
+
+    slab_allocator(slab_allocator &&other) noexcept
+        : resource(std::move(other.resource)), pool(std::exchange(other.pool, nullptr)) { }
+
+    slab_allocator &operator=(const slab_allocator &other) noexcept {
+        resource = other.resource;
+        pool = other.pool;
+        return *this;
+    }
+
+    slab_allocator &operator=(slab_allocator &&other) noexcept {
+        if (this != &other) {
+            resource = std::move(other.resource);
+            pool = std::exchange(other.pool, nullptr);
+        }
+        return *this;
+    }
+
+    T *allocate(size_t count) {
+        if (count != 1) {
+            return static_cast<T *>(::operator new(count * sizeof(T), std::align_val_t { alignof(T) }));
+        }
+        return static_cast<T *>(own_pool().allocate());
+    }
+
+    void deallocate(T *ptr, size_t count) noexcept {
+        if (count != 1) {
+            ::operator delete(ptr, std::align_val_t { alignof(T) });
+            return;
+        }
+        own_pool().deallocate(ptr);
+    }
+
+    // Makes sure next count allocations come from one contiguous slab
+    void reserve(size_t count) {
+        own_pool().reserve(count);
+    }
+
+    // Another allocator shares pool, objects of this one may still be there
+    bool shared() const noexcept {
+        return resource.use_count() > 1;
+    }
+
+    // Objects allocated by other may afterwards be deallocated here. Pool of
+    // other is taken over when nothing else uses it, leaving other empty, or
+    // shared when this allocator has none yet. Returns false, changing
+    // nothing, when both have a pool and other's pool is shared.
+    bool adopt(slab_allocator &other) {
+        if (resource == other.resource || !other.resource) return true;
+        if (!resource) {
+            resource = other.resource;
+            pool = other.pool;
+            return true;
+        }
+        if (other.shared()) return false;
+        resource->adopt(*other.resource);
+        other.resource.reset();
+        other.pool = nullptr;
+        return true;
+    }
+
+    // Drops this allocator's hold on its pool, objects are not destroyed.
+    // Last holder frees all slabs in O(slabs).
+    void release() noexcept {
+        resource.reset();
+        pool = nullptr;
+    }
+
+    template <typename U>
+    bool operator==(const slab_allocator<U, max_slab_bytes> &other) const noexcept { return resource == other.resource; }
+}; // class slab_allocator
+
+} // namespace rohit
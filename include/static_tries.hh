@@ -0,0 +1,428 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <tries.hh>
+#include <mapped_file.hh>
+#include <constexpr_table.hh>
+#include <assert.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace rohit {
+
+// Build once trie kept in a double array. Transition from state s on code c
+// goes to t = base[s] + c, and is valid only if check[t] == s. Code of a key
+// character is its byte value plus one, code 0 leads to terminal cell whose
+// base holds -(value index + 1). Root is state 1, check 0 marks a free cell.
+// Both arrays are pointer free, save() writes them as they are and open()
+// queries a read only mapping of the file without copying.
+template <typename key_type, typename value_type = bool>
+class static_tries {
+public:
+    using key_char_type = key_type::value_type;
+    using pair_type = std::pair<key_type, value_type>;
+    using iterator = const value_type *;
+
+    static_assert(sizeof(key_char_type) == 1, "static_tries supports byte sized characters only");
+
+private:
+    static constexpr uint32_t root_state = 1;
+    static constexpr uint32_t alphabet_size = 257;
+
+    struct cell {
+        int32_t base = 0;
+        uint32_t check = 0;
+    };
+
+    // Wrapped so that bool values are not packed by std::vector<bool>
+    struct value_slot {
+        value_type value;
+    };
+
+    // Filled by build, empty for a trie opened from file
+    std::vector<cell> cells;
+    std::vector<value_slot> values;
+
+    // What search reads, either vectors above or sections of mapping
+    std::span<const cell> cell_view;
+    std::span<const value_slot> value_view;
+    mapped_file mapping;
+
+    // Every cell below this is known to be in use, only used while building
+    size_t first_free = root_state + 1;
+
+    static uint32_t code(key_char_type key_char) {
+        return static_cast<uint32_t>(static_cast<unsigned char>(key_char)) + 1;
+    }
+
+    static uint32_t code_at(const key_type &key, size_t depth) {
+        return depth < key.size() ? code(key[depth]) : 0;
+    }
+
+    void reserve_cells(size_t count) {
+        if (count > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+            throw std::length_error("static_tries: too many states");
+        }
+        if (cells.size() < count) cells.resize(std::max(count, cells.size() + cells.size() / 2));
+    }
+
+    // First base for which all child cells are free. Region scanned before
+    // the fit is skipped by later searches once it is 95% full (as in darts),
+    // this keeps build close to linear at the cost of a few unused cells.
+    uint32_t find_base(const std::vector<uint32_t> &codes) {
+        while(first_free < cells.size() && cells[first_free].check != 0) ++first_free;
+        auto start = std::max<size_t>(first_free, codes.front() + 1);
+        size_t occupied = 0;
+        for(auto position = start;; ++position) {
+            reserve_cells(position + alphabet_size);
+            if (cells[position].check != 0) {
+                ++occupied;
+                continue;
+            }
+            auto base = position - codes.front();
+            bool fits = true;
+            for(auto child_code: codes) {
+                if (cells[base + child_code].check != 0) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) {
+                if (occupied * 20 >= (position - start + 1) * 19) first_free = position;
+                return static_cast<uint32_t>(base);
+            }
+        }
+    }
+
+    // Places children of state, which is shared prefix of sorted[first, last)
+    // of length depth. Keys ending at depth sort first, so codes ascend.
+    void build(const std::vector<pair_type> &sorted, size_t first, size_t last, size_t depth, uint32_t state) {
+        std::vector<uint32_t> codes;
+        std::vector<size_t> starts;
+        for(auto index = first; index < last; ++index) {
+            auto child_code = code_at(sorted[index].first, depth);
+            if (codes.empty() || codes.back() != child_code) {
+                codes.push_back(child_code);
+                starts.push_back(index);
+            }
+        }
+        starts.push_back(last);
+
+        auto base = find_base(codes);
+        cells[state].base = static_cast<int32_t>(base);
+        for(auto child_code: codes) {
+            cells[base + child_code].check = state;
+        }
+
+        for(size_t index = 0; index < codes.size(); ++index) {
+            auto child = base + codes[index];
+            if (codes[index] == 0) {
+                assert(starts[index + 1] - starts[index] == 1);
+                values.push_back({ sorted[starts[index]].second });
+                cells[child].base = -static_cast<int32_t>(values.size());
+            } else {
+                build(sorted, starts[index], starts[index + 1], depth + 1, child);
+            }
+        }
+    }
+
+    void build(std::vector<pair_type> &entries) {
+        auto key_less = [](const pair_type &lhs, const pair_type &rhs) { return lhs.first < rhs.first; };
+        if (!std::is_sorted(entries.begin(), entries.end(), key_less)) {
+            std::stable_sort(entries.begin(), entries.end(), key_less);
+        }
+        // Duplicate keys keep last value, same as insert
+        auto out = entries.begin();
+        for(auto itr = entries.begin(); itr != entries.end(); ++itr) {
+            auto next = std::next(itr);
+            if (next != entries.end() && !(itr->first < next->first)) continue;
+            if (out != itr) *out = std::move(*itr);
+            ++out;
+        }
+        entries.erase(out, entries.end());
+
+        cells.clear();
+        values.clear();
+        values.reserve(entries.size());
+        cells.resize(root_state + alphabet_size);
+        cells[root_state].check = root_state;
+        first_free = root_state + 1;
+        if (!entries.empty()) build(entries, 0, entries.size(), 0, root_state);
+
+        // Trailing cells were only reserved for base search
+        auto used = std::find_if(cells.rbegin(), cells.rend(), [](const cell &item) { return item.check != 0; });
+        cells.resize(cells.rend() - used);
+        cells.shrink_to_fit();
+        cell_view = cells;
+        value_view = values;
+    }
+
+public:
+    static_tries() { }
+    static_tries(const static_tries &) = delete;
+    static_tries &operator=(const static_tries &) = delete;
+    // Moving vector keeps its buffer, so views stay valid
+    static_tries(static_tries &&) = default;
+    static_tries &operator=(static_tries &&) = default;
+
+    // Set of words, any order
+    explicit static_tries(const std::vector<key_type> &words) requires std::same_as<value_type, bool> {
+        std::vector<pair_type> entries;
+        entries.reserve(words.size());
+        for(auto &word: words) entries.emplace_back(word, true);
+        build(entries);
+    }
+
+    // Key value pairs, any order, for duplicate key last one wins
+    explicit static_tries(std::vector<pair_type> entries) {
+        build(entries);
+    }
+
+    // Snapshot of a dynamic tries
+    template <typename TLIST>
+    explicit static_tries(tries<key_type, value_type, TLIST> &source) {
+        std::vector<pair_type> entries;
+        source.for_each([&entries](const key_type &key, const value_type &value) {
+            entries.emplace_back(key, value);
+        });
+        build(entries);
+    }
+
+    // Writes trie to path, replacing any existing file
+    void save(const std::string &path) const requires std::is_trivially_copyable_v<value_type> {
+        auto header = file_header::make(file_format::static_tries, sizeof(key_char_type), sizeof(value_slot), value_view.size());
+        write_sections(path, header, { std::as_bytes(cell_view), std::as_bytes(value_view) });
+    }
+
+    // Trie saved by save(), queried in place. Throws std::system_error if
+    // file cannot be mapped or was not written by a compatible static_tries.
+    static static_tries open(const std::string &path) requires std::is_trivially_copyable_v<value_type> {
+        static_tries result;
+        result.mapping = mapped_file(path);
+        auto &header = read_header(result.mapping, file_format::static_tries, sizeof(key_char_type), sizeof(value_slot));
+        result.cell_view = read_section<cell>(result.mapping, header, 0);
+        result.value_view = read_section<value_slot>(result.mapping, header, 1);
+        if (result.value_view.size() != header.count || (!result.cell_view.empty() && result.cell_view.size() <= root_state)) {
+            throw std::system_error(std::make_error_code(std::errc::invalid_argument), "static_tries: inconsistent file");
+        }
+        return result;
+    }
+
+    // Any tries_lookup is searched in place, see tries
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    iterator search(const lookup_type &key) const {
+        if constexpr (!tries_key<lookup_type, key_char_type>) {
+            return search(std::basic_string_view<key_char_type>(key));
+        } else {
+            if (cell_view.empty()) return end();
+            uint32_t state = root_state;
+            for(auto key_char: key) {
+                auto next = static_cast<uint32_t>(cell_view[state].base) + code(key_char);
+                if (next >= cell_view.size() || cell_view[next].check != state) return end();
+                state = next;
+            }
+            auto terminal = static_cast<uint32_t>(cell_view[state].base);
+            if (terminal >= cell_view.size() || cell_view[terminal].check != state) return end();
+            auto index = static_cast<size_t>(-static_cast<int64_t>(cell_view[terminal].base) - 1);
+            if (index >= value_view.size()) return end();
+            return &value_view[index].value;
+        }
+    }
+
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    bool contains(const lookup_type &key) const {
+        auto result = search(key);
+        if (result == end()) {
+            return false;
+        }
+
+        return *result != default_value<value_type>::value;
+    }
+
+
+    iterator end() const {
+        return nullptr;
+    }
+
+    size_t size() const { return value_view.size(); }
+    bool empty() const { return value_view.empty(); }
+
+    // Heap memory held by the trie, mapped file is not counted
+    size_t memory() const {
+        return cells.capacity() * sizeof(cell) + values.capacity() * sizeof(value_slot);
+    }
+
+}; // class static_tries
+
+// Saves snapshot of a tries, static_tries<key_type, value_type>::open() loads
+// it back without rebuilding
+template <typename key_type, typename value_type, typename TLIST>
+void save(tries<key_type, value_type, TLIST> &source, const std::string &path) {
+    static_tries<key_type, value_type>(source).save(path);
+}
+
+// Trie built during compilation as a DFA. Each state keeps its outgoing edges
+// as one sorted run of the edge array, state 0 is root and every other state
+// has exactly one incoming edge. state_count is number of distinct prefixes
+// of keys, including empty one, and value_count number of distinct keys.
+// A constexpr instance is placed in read only data, no heap and nothing to
+// run at startup.
+template <typename key_type, typename value_type, size_t state_count, size_t value_count>
+class constexpr_tries {
+public:
+    using key_char_type = key_type::value_type;
+    using iterator = const value_type *;
+
+    static_assert(state_count > 0, "constexpr_tries needs at least the root state");
+
+private:
+    using traits_type = key_type::traits_type;
+    static constexpr uint32_t no_value = std::numeric_limits<uint32_t>::max();
+
+    struct state {
+        uint32_t first_edge = 0;
+        uint32_t edge_count = 0;
+        uint32_t value = no_value;
+    };
+
+    struct edge {
+        key_char_type key_char { };
+        uint32_t target = 0;
+    };
+
+    std::array<state, state_count> states { };
+    std::array<edge, state_count - 1> edges { };
+    std::array<value_type, value_count> values { };
+
+    // Keys in [first, last) are sorted and share their first depth characters
+    template <typename pair_type>
+    constexpr void build(const std::array<pair_type, value_count> &sorted, uint32_t current, size_t first, size_t last, size_t depth, uint32_t &next_state, uint32_t &next_edge) {
+        if (sorted[first].first.size() == depth) {
+            states[current].value = static_cast<uint32_t>(first);
+            ++first;
+        }
+        uint32_t edge_count = 0;
+        for(size_t index = first; index < last; ++index) {
+            if (index == first || !traits_type::eq(sorted[index].first[depth], sorted[index - 1].first[depth])) ++edge_count;
+        }
+        states[current].first_edge = next_edge;
+        states[current].edge_count = edge_count;
+        auto edge_index = next_edge;
+        next_edge += edge_count;
+        while(first < last) {
+            auto key_char = sorted[first].first[depth];
+            auto group_last = first + 1;
+            while(group_last < last && traits_type::eq(sorted[group_last].first[depth], key_char)) ++group_last;
+            auto target = next_state++;
+            edges[edge_index++] = { key_char, target };
+            build(sorted, target, first, group_last, depth + 1, next_state, next_edge);
+            first = group_last;
+        }
+    }
+
+public:
+    // Table of keys or key value pairs in any order, see constexpr_entry
+    template <typename table_type>
+    constexpr explicit constexpr_tries(const table_type &entries) {
+        auto sorted = constexpr_sorted_unique<value_count>(entries);
+        for(size_t index = 0; index < value_count; ++index) values[index] = sorted[index].second;
+        if constexpr (value_count > 0) {
+            uint32_t next_state = 1;
+            uint32_t next_edge = 0;
+            build(sorted, 0, 0, value_count, 0, next_state, next_edge);
+        }
+    }
+
+    // Any tries_lookup, see tries. Edges are ordered by traits_type::lt, same
+    // as key comparison, so each step is a binary search.
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    constexpr iterator search(const lookup_type &key) const {
+        if constexpr (!tries_key<lookup_type, key_char_type>) {
+            return search(key_type(key));
+        } else {
+            uint32_t current = 0;
+            for(auto key_char: key) {
+                auto first = edges.begin() + states[current].first_edge;
+                auto last = first + states[current].edge_count;
+                auto itr = std::lower_bound(first, last, key_char, [](const edge &lhs, key_char_type rhs) {
+                    return traits_type::lt(lhs.key_char, rhs);
+                });
+                if (itr == last || !traits_type::eq(itr->key_char, key_char)) return end();
+                current = itr->target;
+            }
+            if (states[current].value == no_value) return end();
+            return &values[states[current].value];
+        }
+    }
+
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    constexpr bool contains(const lookup_type &key) const {
+        auto result = search(key);
+        if (result == end()) {
+            return false;
+        }
+
+        return *result != default_value<value_type>::value;
+    }
+
+    constexpr iterator end() const {
+        return nullptr;
+    }
+
+    constexpr size_t size() const { return value_count; }
+    constexpr bool empty() const { return value_count == 0; }
+
+}; // class constexpr_tries
+
+// Number of distinct prefixes of keys in a table, including empty prefix
+template <typename table_type>
+constexpr size_t constexpr_prefix_count(const table_type &entries) {
+    using entry = constexpr_entry_of<table_type>;
+    auto order = constexpr_order(entries);
+    size_t count = 1;
+    for(size_t index = 0; index < order.size(); ++index) {
+        auto key = entry::key(entries[order[index]]);
+        size_t common = 0;
+        if (index > 0) {
+            auto previous = entry::key(entries[order[index - 1]]);
+            while(common < key.size() && common < previous.size() && key[common] == previous[common]) ++common;
+        }
+        count += key.size() - common;
+    }
+    return count;
+}
+
+// constexpr_tries of a table with static storage, for example
+//   static constexpr std::string_view verbs[] = { "GET", "HEAD", "POST" };
+//   constexpr auto methods = make_constexpr_tries<verbs>();
+template <const auto &entries>
+constexpr auto make_constexpr_tries() {
+    using entry = constexpr_entry_of<std::remove_cvref_t<decltype(entries)>>;
+    return constexpr_tries<typename entry::key_type, typename entry::value_type, constexpr_prefix_count(entries), constexpr_distinct(entries)>(entries);
+}
+
+} // namespace rohit
@@ -0,0 +1,208 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rohit {
+
+// Fixed set of workers, each with its own deque of tasks. Owner pushes and
+// pops at the back, idle workers steal from the front of other deques so
+// that uneven tasks even out. Thread waiting for a batch runs tasks itself,
+// so a task may start a nested batch without deadlock.
+class thread_pool {
+    // Indices [0, count) of one run(), shared by all its tasks
+    struct batch {
+        void (*invoke)(void *, size_t);
+        void *function;
+        std::atomic<size_t> remaining;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    struct task {
+        batch *owner;
+        size_t index;
+    };
+
+    struct alignas(64) worker_queue {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+
+    // Sleeping workers wait for queued to become non zero
+    std::atomic<size_t> queued { 0 };
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // Queue of current thread if it is a worker of this pool
+    struct worker_identity {
+        thread_pool *pool = nullptr;
+        size_t index = 0;
+    };
+
+    static worker_identity &identity() {
+        static thread_local worker_identity result;
+        return result;
+    }
+
+    void push(size_t queue_index, task item) {
+        {
+            std::lock_guard<std::mutex> lock(queues[queue_index]->mutex);
+            queues[queue_index]->tasks.push_back(item);
+        }
+        queued.fetch_add(1, std::memory_order_release);
+    }
+
+    bool pop(size_t queue_index, task &item) {
+        auto &queue = *queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        item = queue.tasks.back();
+        queue.tasks.pop_back();
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool steal(size_t queue_index, task &item) {
+        auto &queue = *queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        item = queue.tasks.front();
+        queue.tasks.pop_front();
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Own queue first, then every other queue starting after own
+    bool find_task(size_t home, task &item) {
+        if (queued.load(std::memory_order_acquire) == 0) return false;
+        if (pop(home, item)) return true;
+        for(size_t offset = 1; offset < queues.size(); ++offset) {
+            if (steal((home + offset) % queues.size(), item)) return true;
+        }
+        return false;
+    }
+
+    static void execute(task item) {
+        auto owner = item.owner;
+        try {
+            owner->invoke(owner->function, item.index);
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(owner->error_mutex);
+            if (!owner->error) owner->error = std::current_exception();
+        }
+        owner->remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void worker_loop(size_t index) {
+        identity() = { this, index };
+        task item;
+        while(true) {
+            if (find_task(index, item)) {
+                execute(item);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) != 0; });
+            if (stopping) return;
+        }
+    }
+
+public:
+    // Queue count is thread_count, calling thread of run() helps the workers
+    explicit thread_pool(size_t thread_count = std::max(1u, std::thread::hardware_concurrency())) {
+        assert(thread_count > 0);
+        for(size_t index = 0; index < thread_count; ++index) {
+            queues.push_back(std::make_unique<worker_queue>());
+        }
+        for(size_t index = 0; index < thread_count; ++index) {
+            workers.emplace_back([this, index] { worker_loop(index); });
+        }
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    // No run() may be active
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto &worker: workers) worker.join();
+    }
+
+    static thread_pool &global() {
+        static thread_pool pool;
+        return pool;
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    // Calls function(index) for every index in [0, count) and returns once
+    // all are done. Calls may run concurrently and in any order. First
+    // exception thrown by a call is rethrown here after the rest finish.
+    template <typename function_type>
+    void run(size_t count, function_type &&function) {
+        if (count == 0) return;
+        batch current;
+        current.invoke = [](void *function, size_t index) { (*static_cast<std::remove_reference_t<function_type> *>(function))(index); };
+        current.function = std::addressof(function);
+        current.remaining.store(count, std::memory_order_relaxed);
+
+        // Worker keeps its own batch at home, stealing spreads it. Outside
+        // caller deals tasks round robin.
+        auto &self = identity();
+        bool inside = self.pool == this;
+        size_t home = inside ? self.index : 0;
+        for(size_t index = count; index-- > 0;) {
+            push(inside ? home : index % queues.size(), { &current, index });
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        wake.notify_all();
+
+        task item;
+        while(current.remaining.load(std::memory_order_acquire) != 0) {
+            if (find_task(home, item)) execute(item);
+            else std::this_thread::yield();
+        }
+        if (current.error) std::rethrow_exception(current.error);
+    }
+
+}; // class thread_pool
+
+} // namespace rohit
@@ -15,9 +15,19 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <slab_allocator.hh>
+#include <tree_stats.hh>
 #include <assert.h>
 #include <algorithm>
+#include <bit>
 #include <concepts>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace rohit {
 
@@ -28,11 +38,53 @@ enum class blancing_type {
     avl
 };
 
-template <typename key_type, typename value_type, blancing_type impl>
+// Node augmentation policy, extra data is kept in nodes only when selected
+struct no_augment { };
+struct order_statistic { }; // Subtree size for rank and select
+
+template <typename augment_type>
+struct bst_node_augment { };
+
+// Statistics are kept in the tree, node has wrapped augmentation only
+template <typename augment_type>
+struct bst_node_augment<with_stats<augment_type>> : bst_node_augment<augment_type> { };
+
+// Type which is compared with key_type directly in lookups, for example
+// std::string_view or const char * for std::string keys. Arithmetic types are
+// excluded so that mixed sign or precision comparisons never happen silently.
+template <typename lookup_type, typename key_type>
+concept transparent_key = !std::is_arithmetic_v<lookup_type> &&
+    requires(const lookup_type &lookup, const key_type &key) {
+        { lookup < key } -> std::convertible_to<bool>;
+        { key < lookup } -> std::convertible_to<bool>;
+        { key == lookup } -> std::convertible_to<bool>;
+    };
+
+// Accepted by bst lookups: key_type, a transparent key, or anything else
+// convertible to key_type, which is converted once before the search
+template <typename lookup_type, typename key_type>
+concept bst_lookup = std::same_as<lookup_type, key_type> || transparent_key<lookup_type, key_type> ||
+    std::convertible_to<const lookup_type &, key_type>;
+
+// Forwarded key argument of insert, key_type of a new node is built from it
+template <typename lookup_type, typename key_type>
+concept bst_insert_key = bst_lookup<std::remove_cvref_t<lookup_type>, key_type> && std::constructible_from<key_type, lookup_type>;
+
+template <>
+struct bst_node_augment<order_statistic> {
+    size_t size = 1; // Count of nodes in subtree rooted here
+};
+
+// Nodes keep subtree size, augment_type may be wrapped in with_stats
+template <typename augment_type>
+inline constexpr bool order_statistic_augment = std::is_same_v<typename bst_augment<augment_type>::type, order_statistic>;
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type = no_augment>
     requires std::totally_ordered<key_type>
 struct bst_node;
 
-template <typename key_type, typename value_type, blancing_type impl>
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type = no_augment,
+    typename allocator_type = slab_allocator<bst_node<key_type, value_type, impl, augment_type>>>
     requires std::totally_ordered<key_type>
 class bst;
 
@@ -42,30 +94,512 @@ struct bst_node_base {
     key_type key;
     value_type value;
 
-    bst_node_base(const key_type &key, const value_type &value) : key(key), value(value) { }
+    // Key and value are built in place from forwarded arguments
+    template <typename init_type, typename... args_type>
+    bst_node_base(std::in_place_t, init_type &&key, args_type &&... args) :
+        key(std::forward<init_type>(key)), value(std::forward<args_type>(args)...) { }
 }; // class bst_node_base
 
-template <typename key_type, typename value_type>
+template <typename key_type, typename value_type, typename augment_type>
     requires std::totally_ordered<key_type>
-struct bst_node<key_type, value_type, blancing_type::none> :
-    public bst_node_base<key_type, value_type>
+struct bst_node<key_type, value_type, blancing_type::none, augment_type> :
+    public bst_node_base<key_type, value_type>,
+    public bst_node_augment<augment_type>
 {
     using base_type = bst_node_base<key_type, value_type>;
 
     bst_node *left = nullptr;
     bst_node *right = nullptr;
+    bst_node *parent = nullptr;
 
-    bst_node(const key_type &key, const value_type &value) : base_type(key, value) { }
+    template <typename... args_type>
+    bst_node(std::in_place_t, args_type &&... args) : base_type(std::in_place, std::forward<args_type>(args)...) { }
 }; // struct bst_node<key_type, value_type, blancing_type::none>
 
-template <typename key_type, typename value_type, blancing_type impl>
+// In order iterator walking parent links, no allocation and no stack.
+// node_type is const qualified for const_iterator. End is nullptr node, tree
+// root is kept so that end can be decremented.
+template <typename node_type>
+class bst_iterator {
+    node_type *node = nullptr;
+    node_type * const *root = nullptr;
+
+    template <typename other_type>
+    friend class bst_iterator;
+
+    static node_type * leftmost(node_type *node) {
+        while(node->left != nullptr) node = node->left;
+        return node;
+    }
+
+    static node_type * rightmost(node_type *node) {
+        while(node->right != nullptr) node = node->right;
+        return node;
+    }
+
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = std::remove_const_t<node_type>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = node_type *;
+    using reference = node_type &;
+
+    bst_iterator() { }
+    bst_iterator(node_type *node, node_type * const *root) : node(node), root(root) { }
+
+    // iterator to const_iterator
+    template <typename other_type>
+        requires (!std::is_same_v<other_type, node_type> && std::is_same_v<const other_type, node_type>)
+    bst_iterator(const bst_iterator<other_type> &other) : node(other.node), root(other.root) { }
+
+    reference operator*() const { return *node; }
+    pointer operator->() const { return node; }
+
+    bst_iterator &operator++() {
+        if (node->right != nullptr) {
+            node = leftmost(node->right);
+            return *this;
+        }
+        auto parent = node->parent;
+        while(parent != nullptr && node == parent->right) {
+            node = parent;
+            parent = parent->parent;
+        }
+        node = parent;
+        return *this;
+    }
+
+    bst_iterator operator++(int) {
+        auto result = *this;
+        ++*this;
+        return result;
+    }
+
+    bst_iterator &operator--() {
+        if (node == nullptr) {
+            node = rightmost(*root);
+            return *this;
+        }
+        if (node->left != nullptr) {
+            node = rightmost(node->left);
+            return *this;
+        }
+        auto parent = node->parent;
+        while(parent != nullptr && node == parent->left) {
+            node = parent;
+            parent = parent->parent;
+        }
+        node = parent;
+        return *this;
+    }
+
+    bst_iterator operator--(int) {
+        auto result = *this;
+        --*this;
+        return result;
+    }
+
+    friend bool operator==(const bst_iterator &lhs, const bst_iterator &rhs) {
+        return lhs.node == rhs.node;
+    }
+}; // class bst_iterator
+
+// Runs function(index) for every index in [0, count) on calling thread. Same
+// interface as thread_pool::run, default for operations with a parallel mode.
+struct sequential_executor {
+    template <typename function_type>
+    void run(size_t count, function_type &&function) {
+        for(size_t index = 0; index < count; ++index) function(index);
+    }
+}; // struct sequential_executor
+
+template <typename executor_type>
+concept bst_executor = requires(executor_type &executor) {
+    executor.run(size_t { }, [](size_t) { });
+};
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
     requires std::totally_ordered<key_type>
 class bst_base {
 public:
-    using node_type = bst_node<key_type, value_type, impl>;
+    using node_type = bst_node<key_type, value_type, impl, augment_type>;
+    using node_allocator_type = std::allocator_traits<allocator_type>::template rebind_alloc<node_type>;
+    using node_allocator_traits = std::allocator_traits<node_allocator_type>;
+    using iterator = bst_iterator<node_type>;
+    using const_iterator = bst_iterator<const node_type>;
+    // bst_base is only ever the base of this bst
+    using tree_type = bst<key_type, value_type, impl, augment_type, allocator_type>;
 
     node_type *root = nullptr;
 
+protected:
+    [[no_unique_address]] node_allocator_type node_allocator { };
+    size_t count = 0;
+
+    static constexpr bool stats_enabled = bst_augment<augment_type>::stats;
+    [[no_unique_address]] mutable std::conditional_t<stats_enabled, bst_counters, bst_no_counters> counters;
+
+    // Compiled out unless augment_type is with_stats
+    void record(bst_counters::index_type index, uint64_t amount = 1) const {
+        if constexpr (stats_enabled) counters.add(index, amount);
+    }
+
+    void record_depth(size_t depth) const {
+        if constexpr (stats_enabled) counters.raise(bst_counters::max_depth, depth);
+    }
+
+    // Slab like allocator can drop all nodes at once, while no other tree
+    // shares its pool
+    static constexpr bool releasable = requires(node_allocator_type &alloc) {
+        alloc.release();
+        { alloc.shared() } -> std::convertible_to<bool>;
+    };
+
+    template <typename init_type, typename... args_type>
+    node_type * create_node(init_type &&key, args_type &&... args) {
+        auto node = node_allocator_traits::allocate(node_allocator, 1);
+        try {
+            node_allocator_traits::construct(node_allocator, node, std::in_place, std::forward<init_type>(key), std::forward<args_type>(args)...);
+        } catch(...) {
+            node_allocator_traits::deallocate(node_allocator, node, 1);
+            throw;
+        }
+        ++count;
+        record(bst_counters::allocations);
+        return node;
+    }
+
+    void destroy_node(node_type * node) {
+        node_allocator_traits::destroy(node_allocator, node);
+        node_allocator_traits::deallocate(node_allocator, node, 1);
+        --count;
+        record(bst_counters::deallocations);
+    }
+
+    // Child links are only changed through these so that parent stays in sync
+    static void set_left(node_type * node, node_type * child) {
+        node->left = child;
+        if (child != nullptr) child->parent = node;
+    }
+
+    static void set_right(node_type * node, node_type * child) {
+        node->right = child;
+        if (child != nullptr) child->parent = node;
+    }
+
+    void set_root(node_type * node) {
+        root = node;
+        if (node != nullptr) node->parent = nullptr;
+    }
+
+    static constexpr bool order_statistic_enabled = order_statistic_augment<augment_type>;
+
+    static size_t subtree_size(const node_type * node) {
+        return node != nullptr ? node->size : 0;
+    }
+
+    // Rotated nodes are recomputed from their children, lower node first
+    static void update_size(node_type * node) {
+        if constexpr (order_statistic_enabled) {
+            node->size = 1 + subtree_size(node->left) + subtree_size(node->right);
+        }
+    }
+
+    // Counts new node in every ancestor, called as soon as node is linked and
+    // before any rotation, so that rotations see final sizes
+    static void grow_ancestors(node_type * node) {
+        if constexpr (order_statistic_enabled) {
+            for(node = node->parent; node != nullptr; node = node->parent) ++node->size;
+        }
+    }
+
+    // Drops node from every ancestor, called right before node is unlinked
+    static void shrink_ancestors(node_type * node) {
+        if constexpr (order_statistic_enabled) {
+            for(node = node->parent; node != nullptr; node = node->parent) --node->size;
+        }
+    }
+
+    // What a lookup compares with: key itself when it is key_type or
+    // transparent, otherwise a key_type converted from it
+    template <typename lookup_type>
+    static decltype(auto) probe(const lookup_type &key) {
+        if constexpr (std::same_as<lookup_type, key_type> || transparent_key<lookup_type, key_type>) return (key);
+        else return key_type(key);
+    }
+
+    // Node moved into place of erased node takes over its augmented data
+    static void replace_augment(node_type * node, const node_type * erased) {
+        static_cast<bst_node_augment<augment_type> &>(*node) = static_cast<const bst_node_augment<augment_type> &>(*erased);
+    }
+
+    // Balanced trees are at most twice the optimal height, so this bounds the
+    // path for any size_t count of nodes
+    static constexpr size_t max_height = 2 * std::numeric_limits<size_t>::digits;
+
+    // Records link to every ancestor on search path of key, depth is set to
+    // count of ancestors. Returns link which holds key or where it goes.
+    template <typename probe_type>
+    node_type ** search_path(const probe_type &key, node_type **path[], size_t &depth) {
+        node_type **link = &root;
+        depth = 0;
+        while(*link != nullptr && !((*link)->key == key)) {
+            assert(depth < max_height);
+            path[depth++] = link;
+            link = key < (*link)->key ? &(*link)->left : &(*link)->right;
+        }
+        if (*link == nullptr) {
+            record(bst_counters::insert_visits, depth);
+            record_depth(depth + 1);
+        } else record(bst_counters::insert_visits, depth + 1);
+        return link;
+    }
+
+    // Node holding key or nullptr, for erase, so it is not counted as lookup
+    node_type * locate(const key_type &key) const {
+        auto curr = root;
+        while(curr != nullptr && !(curr->key == key)) {
+            curr = key < curr->key ? curr->left : curr->right;
+        }
+        return curr;
+    }
+
+    // Link in parent, or root, which holds node
+    node_type ** link_of(node_type * node) {
+        auto parent = node->parent;
+        if (parent == nullptr) return &root;
+        return parent->left == node ? &parent->left : &parent->right;
+    }
+
+    // Split, join and set operations, only for trees with a join of cost
+    // O(height difference). Nodes move between trees, so either any tree can
+    // free them or receiving tree adopts pool of giving one (slab_allocator).
+    static constexpr bool shares_nodes = std::allocator_traits<node_allocator_type>::is_always_equal::value;
+    static constexpr bool adopts_nodes = requires(node_allocator_type &alloc) { alloc.adopt(alloc); };
+    static constexpr bool joinable = (impl == blancing_type::avl || impl == blancing_type::red_black) &&
+        (shares_nodes || adopts_nodes);
+
+    // Subtree root with its height, avl height or red black black height.
+    // Parent of root may be stale until subtree is linked again.
+    struct subtree {
+        node_type *root;
+        int height;
+    };
+
+    // Keys less than key, node holding key or nullptr, keys greater than key
+    struct split_result {
+        subtree left;
+        node_type *node;
+        subtree right;
+    };
+
+    // Subtrees below recursion are run in parallel while budget lasts and
+    // both sides are at least this high
+    static constexpr int parallel_height = 8;
+
+    split_result split_subtree(subtree tree, const key_type &key) {
+        if (tree.root == nullptr) return { { nullptr, 0 }, nullptr, { nullptr, 0 } };
+        auto node = tree.root;
+        auto [left, right] = this->tree().children(tree);
+        if (node->key == key) return { left, node, right };
+        if (key < node->key) {
+            auto result = split_subtree(left, key);
+            result.right = this->tree().join_subtrees(result.right, node, right);
+            return result;
+        }
+        auto result = split_subtree(right, key);
+        result.left = this->tree().join_subtrees(left, node, result.left);
+        return result;
+    }
+
+    // Largest node taken out, rest joined back
+    std::pair<subtree, node_type *> split_last(subtree tree) {
+        auto node = tree.root;
+        auto [left, right] = this->tree().children(tree);
+        if (right.root == nullptr) return { left, node };
+        auto [rest, last] = split_last(right);
+        return { this->tree().join_subtrees(left, node, rest), last };
+    }
+
+    // Join without a middle key, every key of left is less than right
+    subtree join_pair(subtree left, subtree right) {
+        if (left.root == nullptr) return right;
+        auto [rest, last] = split_last(left);
+        return this->tree().join_subtrees(rest, last, right);
+    }
+
+    // Nodes dropped by a set operation, chained through right link and freed
+    // once operation is over, so that parallel branches never use allocator
+    struct removed_nodes {
+        node_type *first = nullptr;
+        node_type *last = nullptr;
+
+        void push(node_type * node) {
+            node->right = first;
+            if (first == nullptr) last = node;
+            first = node;
+        }
+
+        void append(const removed_nodes &other) {
+            if (other.first == nullptr) return;
+            if (first == nullptr) first = other.first;
+            else last->right = other.first;
+            last = other.last;
+        }
+
+        void push_subtree(node_type * node) {
+            while(node) {
+                if (node->left != nullptr) {
+                    auto left = node->left;
+                    node->left = left->right;
+                    left->right = node;
+                    node = left;
+                } else {
+                    auto right = node->right;
+                    push(node);
+                    node = right;
+                }
+            }
+        }
+    };
+
+    // Copy of subtree allocated by this tree, colours and heights are kept
+    node_type * copy_nodes(const node_type * node, node_type * parent) {
+        if (node == nullptr) return nullptr;
+        auto copy = node_allocator_traits::allocate(node_allocator, 1);
+        try {
+            node_allocator_traits::construct(node_allocator, copy, *node);
+        } catch(...) {
+            node_allocator_traits::deallocate(node_allocator, copy, 1);
+            throw;
+        }
+        record(bst_counters::allocations);
+        copy->parent = parent;
+        copy->left = copy->right = nullptr;
+        try {
+            copy->left = copy_nodes(node->left, copy);
+            copy->right = copy_nodes(node->right, copy);
+        } catch(...) {
+            free_copy(copy);
+            throw;
+        }
+        return copy;
+    }
+
+    void free_copy(node_type * node) {
+        if (node == nullptr) return;
+        free_copy(node->left);
+        free_copy(node->right);
+        node_allocator_traits::destroy(node_allocator, node);
+        node_allocator_traits::deallocate(node_allocator, node, 1);
+        record(bst_counters::deallocations);
+    }
+
+    // Nodes of other join this tree as returned subtree, other is left empty.
+    // Pool of other is adopted, or shared when this tree has none yet. If
+    // another tree still uses that pool, nodes of other are copied instead.
+    subtree take_nodes(tree_type &other) {
+        assert(&other != this);
+        if constexpr (!shares_nodes) {
+            if (!(node_allocator == other.node_allocator) && !node_allocator.adopt(other.node_allocator)) {
+                auto copy = copy_nodes(other.root, nullptr);
+                auto size = other.count;
+                other.clear();
+                other.root = copy;
+                other.count = size;
+            }
+        }
+        auto result = other.whole();
+        count += std::exchange(other.count, 0);
+        other.root = nullptr;
+        return result;
+    }
+
+    template <typename executor_type, typename left_function, typename right_function>
+    static void fork(executor_type &executor, int budget, subtree first, subtree second, left_function &&left, right_function &&right) {
+        if (budget > 0 && std::min(first.height, second.height) >= parallel_height) {
+            executor.run(2, [&](size_t index) {
+                if (index == 0) left(budget - 1);
+                else right(budget - 1);
+            });
+        } else {
+            left(0);
+            right(0);
+        }
+    }
+
+    enum class set_operation { union_of, intersection, difference };
+
+    // Second is split around by first's pieces, recursion on both halves is
+    // independent. Union keeps node of second for a duplicate key,
+    // intersection and difference keep node of first.
+    template <set_operation operation, typename executor_type>
+    subtree combine(subtree first, subtree second, removed_nodes &removed, executor_type &executor, int budget) {
+        if constexpr (operation == set_operation::union_of) {
+            if (first.root == nullptr) return second;
+            if (second.root == nullptr) return first;
+        } else if constexpr (operation == set_operation::intersection) {
+            if (first.root == nullptr || second.root == nullptr) {
+                removed.push_subtree(first.root);
+                removed.push_subtree(second.root);
+                return { nullptr, 0 };
+            }
+        } else {
+            if (first.root == nullptr) {
+                removed.push_subtree(second.root);
+                return { nullptr, 0 };
+            }
+            if (second.root == nullptr) return first;
+        }
+
+        auto node = second.root;
+        auto [second_left, second_right] = this->tree().children(second);
+        auto split = split_subtree(first, node->key);
+        subtree left, right;
+        removed_nodes right_removed;
+        fork(executor, budget, first, second,
+            [&](int next_budget) { left = combine<operation>(split.left, second_left, removed, executor, next_budget); },
+            [&](int next_budget) { right = combine<operation>(split.right, second_right, right_removed, executor, next_budget); });
+        removed.append(right_removed);
+
+        if constexpr (operation == set_operation::union_of) {
+            if (split.node) removed.push(split.node);
+            return this->tree().join_subtrees(left, node, right);
+        } else if constexpr (operation == set_operation::intersection) {
+            removed.push(node);
+            if (split.node) return this->tree().join_subtrees(left, split.node, right);
+            return join_pair(left, right);
+        } else {
+            removed.push(node);
+            if (split.node) removed.push(split.node);
+            return join_pair(left, right);
+        }
+    }
+
+    // Nodes of other are taken over, other is left empty
+    template <set_operation operation, typename executor_type>
+    void combine_with(tree_type &other, executor_type &executor, int budget) {
+        auto first = this->tree().whole();
+        auto second = take_nodes(other);
+        removed_nodes removed;
+        auto result = combine<operation>(first, second, removed, executor, budget);
+        this->tree().finish(result);
+        for(auto node = removed.first; node != nullptr;) {
+            auto next = node->right;
+            destroy_node(node);
+            node = next;
+        }
+    }
+
+    // Levels of recursion forked in parallel, about four tasks per thread
+    // when executor tells its size
+    template <typename executor_type>
+    static int parallel_budget(executor_type &executor) {
+        if constexpr (std::same_as<std::remove_cvref_t<executor_type>, sequential_executor>) return 0;
+        else if constexpr (requires { executor.size(); }) return std::bit_width(executor.size()) + 2;
+        else return 2;
+    }
+
 private:
     size_t depth(node_type * root) {
         if (root == nullptr) return 0;
@@ -75,205 +609,1116 @@ private:
         return std::max(left_depth, right_depth) + 1;
     }
 
-public:
-    auto find(const key_type &key) {
+    static node_type * leftmost(node_type * node) {
+        while(node->left != nullptr) node = node->left;
+        return node;
+    }
+
+    static node_type * rightmost(node_type * node) {
+        while(node->right != nullptr) node = node->right;
+        return node;
+    }
+
+    // Visit count is dropped by compiler unless stats are enabled
+    void record_lookup(size_t visits, bool hit) const {
+        record(bst_counters::lookups);
+        record(bst_counters::lookup_visits, visits);
+        if (hit) record(bst_counters::lookup_hits);
+        record_depth(visits);
+    }
+
+    template <typename probe_type>
+    node_type * find_node(const probe_type &key) const {
         auto curr = root;
+        size_t visits = 0;
         while(curr) {
+            ++visits;
             if (curr->key == key) {
+                record_lookup(visits, true);
                 return curr;
             }
 
-            if (key <= curr->key) {
+            if (key < curr->key) {
                 curr = curr->left;
             } else {
                 curr = curr->right;
             }
         }
-        return end();
+        record_lookup(visits, false);
+        return nullptr;
     }
 
-    size_t depth() {
-        return depth(root);
+    // Descents in flight at once in find_batch. Enough misses to keep memory
+    // busy, few enough that lanes stay in registers and L1.
+    static constexpr size_t batch_width = 16;
+
+    // Finds every key with up to batch_width descents interleaved. Each round
+    // moves every lane one node down and prefetches the node it goes to next,
+    // so by the time a lane comes round again its node is usually in cache.
+    // A lane which is done takes next key right away (AMAC), a long search
+    // does not hold up the rest. function(index, node) gets node of
+    // keys[index] or nullptr, in no particular order.
+    template <typename lookup_type, typename function_type>
+    void find_batch_nodes(std::span<const lookup_type> keys, function_type &&function) const {
+        struct lane {
+            size_t index;
+            node_type *curr;
+            size_t visits;
+        };
+        lane lanes[batch_width];
+        size_t active = 0;
+        size_t next = 0;
+        for(; active < batch_width && next < keys.size(); ++active, ++next) lanes[active] = { next, root, 0 };
+
+        while(active) {
+            for(size_t index = 0; index < active;) {
+                auto &current = lanes[index];
+                auto curr = current.curr;
+                auto &key = keys[current.index];
+                if (curr != nullptr) ++current.visits;
+                if (curr == nullptr || curr->key == key) {
+                    record_lookup(current.visits, curr != nullptr);
+                    function(current.index, curr);
+                    if (next < keys.size()) current = { next++, root, 0 };
+                    else current = lanes[--active];
+                    continue;
+                }
+                curr = key < curr->key ? curr->left : curr->right;
+                if (curr) __builtin_prefetch(curr);
+                current.curr = curr;
+                ++index;
+            }
+        }
     }
 
-    node_type * end() {
+    template <typename probe_type>
+    node_type * lower_bound_node(const probe_type &key) const {
+        node_type *result = nullptr;
+        auto curr = root;
+        while(curr) {
+            if (curr->key < key) {
+                curr = curr->right;
+            } else {
+                result = curr;
+                curr = curr->left;
+            }
+        }
+        return result;
+    }
+
+    node_type * select_node(size_t index) const {
+        auto curr = root;
+        while(curr) {
+            auto left_size = subtree_size(curr->left);
+            if (index == left_size) return curr;
+            if (index < left_size) {
+                curr = curr->left;
+            } else {
+                index -= left_size + 1;
+                curr = curr->right;
+            }
+        }
         return nullptr;
     }
 
+    template <typename probe_type>
+    node_type * upper_bound_node(const probe_type &key) const {
+        node_type *result = nullptr;
+        auto curr = root;
+        while(curr) {
+            if (key < curr->key) {
+                result = curr;
+                curr = curr->left;
+            } else {
+                curr = curr->right;
+            }
+        }
+        return result;
+    }
+
+    using pair_type = std::pair<key_type, value_type>;
+
+    static bool key_less(const pair_type &lhs, const pair_type &rhs) {
+        return lhs.first < rhs.first;
+    }
+
+    // Sorts by key, for duplicate keys last one wins same as insert.
+    // Optional execution policy is passed on to std::stable_sort.
+    template <typename iterator_type, typename... execution_policy>
+    static std::vector<pair_type> sort_unique(iterator_type first, iterator_type last, execution_policy &&...policy) {
+        std::vector<pair_type> sorted(first, last);
+        std::stable_sort(std::forward<execution_policy>(policy)..., sorted.begin(), sorted.end(), key_less);
+
+        auto out = sorted.begin();
+        for(auto itr = sorted.begin(); itr != sorted.end(); ++itr) {
+            auto next = std::next(itr);
+            if (next != sorted.end() && !key_less(*itr, *next)) continue;
+            if (out != itr) *out = std::move(*itr);
+            ++out;
+        }
+        sorted.erase(out, sorted.end());
+        return sorted;
+    }
+
+    // Middle element becomes root, subtree sizes differ by at most one so
+    // it is a valid avl tree as well.
+    template <typename iterator_type>
+    node_type * build_balanced(iterator_type first, size_t size) {
+        if (size == 0) return nullptr;
+        auto mid = size / 2;
+        auto left = build_balanced(first, mid);
+        auto node = create_node(first[mid].first, first[mid].second);
+        set_left(node, left);
+        set_right(node, build_balanced(first + mid + 1, size - mid - 1));
+        update_size(node);
+        if constexpr (impl == blancing_type::avl) {
+            int left_count = node->left ? node->left->count : 0;
+            int right_count = node->right ? node->right->count : 0;
+            node->count = std::max(left_count, right_count) + 1;
+        }
+        return node;
+    }
+
+    // Largest 2-3 tree with given black height, saturates on overflow
+    static size_t max_red_black_size(size_t black_height) {
+        size_t result = 1;
+        for(size_t count = 0; count < black_height; ++count) {
+            if (result > std::numeric_limits<size_t>::max() / 3) return std::numeric_limits<size_t>::max();
+            result *= 3;
+        }
+        return result - 1;
+    }
+
+    // Builds a 2-3 tree of exact black height, 3-node is a black node with
+    // red left child. Such tree is valid for both red black variants.
+    // Requires 2^black_height - 1 <= size <= 3^black_height - 1.
+    template <typename iterator_type>
+    node_type * build_red_black(iterator_type first, size_t size, size_t black_height) {
+        if (black_height == 0) {
+            assert(size == 0);
+            return nullptr;
+        }
+
+        auto child_max = max_red_black_size(black_height - 1);
+        if (child_max > std::numeric_limits<size_t>::max() / 2 || size - 1 <= 2 * child_max) {
+            auto left_size = (size - 1) / 2;
+            auto left = build_red_black(first, left_size, black_height - 1);
+            auto node = create_node(first[left_size].first, first[left_size].second);
+            node->red = false;
+            set_left(node, left);
+            set_right(node, build_red_black(first + left_size + 1, size - left_size - 1, black_height - 1));
+            update_size(node);
+            return node;
+        }
+
+        auto rest = size - 2;
+        auto first_size = rest / 3;
+        auto second_size = (rest - first_size) / 2;
+        auto third_size = rest - first_size - second_size;
+
+        auto left = build_red_black(first, first_size, black_height - 1);
+        auto red = create_node(first[first_size].first, first[first_size].second);
+        set_left(red, left);
+        set_right(red, build_red_black(first + first_size + 1, second_size, black_height - 1));
+        update_size(red);
+
+        auto node = create_node(first[first_size + second_size + 1].first, first[first_size + second_size + 1].second);
+        node->red = false;
+        set_left(node, red);
+        set_right(node, build_red_black(first + first_size + second_size + 2, third_size, black_height - 1));
+        update_size(node);
+        return node;
+    }
+
+    template <std::random_access_iterator iterator_type>
+    void build(iterator_type first, size_t size) {
+        clear();
+        if constexpr (requires(node_allocator_type &alloc) { alloc.reserve(size); }) {
+            node_allocator.reserve(size);
+        }
+
+        if (size == 0) return;
+        if constexpr (impl == blancing_type::red_black || impl == blancing_type::red_black_leftleaning) {
+            root = build_red_black(first, size, std::bit_width(size + 1) - 1);
+        } else {
+            root = build_balanced(first, size);
+        }
+    }
+
+    // Any policy std::stable_sort accepts, <execution> is left to the caller
+    // so that sequential users need not link parallel backend.
+    template <typename execution_policy>
+    static constexpr bool sort_policy = requires(execution_policy &&policy, std::vector<pair_type> &sorted) {
+        std::stable_sort(policy, sorted.begin(), sorted.end(), key_less);
+    };
+
+public:
+    bst_base() { }
+    explicit bst_base(const allocator_type &alloc) : node_allocator(alloc) { }
+
+    template <std::forward_iterator iterator_type>
+    bst_base(iterator_type first, iterator_type last) {
+        bulk_load(first, last);
+    }
+
+    template <typename execution_policy, std::forward_iterator iterator_type>
+        requires sort_policy<execution_policy>
+    bst_base(execution_policy &&policy, iterator_type first, iterator_type last) {
+        bulk_load(std::forward<execution_policy>(policy), first, last);
+    }
+
+    bst_base(const bst_base &) = delete;
+    bst_base &operator=(const bst_base &) = delete;
+
+    bst_base(bst_base &&other) noexcept
+        : root(std::exchange(other.root, nullptr)), node_allocator(std::move(other.node_allocator)),
+          count(std::exchange(other.count, 0)), counters(other.counters) { }
+
+    bst_base &operator=(bst_base &&other) noexcept {
+        if (this != &other) {
+            clear();
+            root = std::exchange(other.root, nullptr);
+            node_allocator = std::move(other.node_allocator);
+            count = std::exchange(other.count, 0);
+            counters = other.counters;
+        }
+        return *this;
+    }
+
+    ~bst_base() {
+        clear();
+    }
+
+    // Trivially destructible nodes on releasable allocator are dropped in O(slabs).
+    // Otherwise tree is unwound by right rotations, no recursion or stack is used.
+    void clear() {
+        bool drop_pool = false;
+        if constexpr (releasable) drop_pool = !node_allocator.shared();
+        if (!drop_pool || !std::is_trivially_destructible_v<node_type>) {
+            auto curr = root;
+            while(curr) {
+                if (curr->left != nullptr) {
+                    auto left = curr->left;
+                    curr->left = left->right;
+                    left->right = curr;
+                    curr = left;
+                } else {
+                    auto right = curr->right;
+                    if (drop_pool) node_allocator_traits::destroy(node_allocator, curr);
+                    else destroy_node(curr);
+                    curr = right;
+                }
+            }
+        }
+
+        if constexpr (releasable) {
+            if (drop_pool) {
+                record(bst_counters::deallocations, count);
+                node_allocator.release();
+            }
+        }
+        root = nullptr;
+        count = 0;
+        if constexpr (stats_enabled) counters.set(bst_counters::max_depth, 0);
+    }
+
+    // Replaces content with key value pairs in [first, last). Strictly sorted
+    // random access input is built in place in O(n), anything else is sorted
+    // first. Colours (red black) and heights (avl) are set while building.
+    template <std::forward_iterator iterator_type>
+    void bulk_load(iterator_type first, iterator_type last) {
+        if constexpr (std::random_access_iterator<iterator_type>) {
+            auto strictly_sorted = std::adjacent_find(first, last, [](const auto &lhs, const auto &rhs) {
+                return !(lhs.first < rhs.first);
+            }) == last;
+            if (strictly_sorted) {
+                build(first, static_cast<size_t>(last - first));
+                return;
+            }
+        }
+
+        auto sorted = sort_unique(first, last);
+        build(sorted.begin(), sorted.size());
+    }
+
+    // Same as above but input is always sorted with given execution policy,
+    // std::execution::par sorts in parallel.
+    template <typename execution_policy, std::forward_iterator iterator_type>
+        requires sort_policy<execution_policy>
+    void bulk_load(execution_policy &&policy, iterator_type first, iterator_type last) {
+        auto sorted = sort_unique(first, last, std::forward<execution_policy>(policy));
+        build(sorted.begin(), sorted.size());
+    }
+
+    // Lookups take any bst_lookup type, a std::string_view or const char *
+    // finds a std::string key without building one
+    template <bst_lookup<key_type> lookup_type = key_type>
+    iterator find(const lookup_type &key) {
+        return iterator(find_node(probe(key)), &root);
+    }
+
+    template <bst_lookup<key_type> lookup_type = key_type>
+    const_iterator find(const lookup_type &key) const {
+        return const_iterator(find_node(probe(key)), &root);
+    }
+
+    // results[i] gets find(keys[i]), results must hold at least keys.size()
+    // entries. Faster than a loop of find once tree is larger than cache, see
+    // find_batch_nodes. Other lookup types must compare with key_type directly
+    // and are named explicitly, find_batch<std::string_view>(views, results).
+    template <typename lookup_type = key_type>
+        requires std::same_as<lookup_type, key_type> || transparent_key<lookup_type, key_type>
+    void find_batch(std::span<const std::type_identity_t<lookup_type>> keys, std::span<iterator> results) {
+        assert(results.size() >= keys.size());
+        find_batch_nodes(keys, [&](size_t index, node_type *node) {
+            results[index] = iterator(node, &root);
+        });
+    }
+
+    template <typename lookup_type = key_type>
+        requires std::same_as<lookup_type, key_type> || transparent_key<lookup_type, key_type>
+    void find_batch(std::span<const std::type_identity_t<lookup_type>> keys, std::span<const_iterator> results) const {
+        assert(results.size() >= keys.size());
+        find_batch_nodes(keys, [&](size_t index, node_type *node) {
+            results[index] = const_iterator(node, &root);
+        });
+    }
+
+    // First element not less than key
+    template <bst_lookup<key_type> lookup_type = key_type>
+    iterator lower_bound(const lookup_type &key) {
+        return iterator(lower_bound_node(probe(key)), &root);
+    }
+
+    template <bst_lookup<key_type> lookup_type = key_type>
+    const_iterator lower_bound(const lookup_type &key) const {
+        return const_iterator(lower_bound_node(probe(key)), &root);
+    }
+
+    // First element greater than key
+    template <bst_lookup<key_type> lookup_type = key_type>
+    iterator upper_bound(const lookup_type &key) {
+        return iterator(upper_bound_node(probe(key)), &root);
+    }
+
+    template <bst_lookup<key_type> lookup_type = key_type>
+    const_iterator upper_bound(const lookup_type &key) const {
+        return const_iterator(upper_bound_node(probe(key)), &root);
+    }
+
+    // Keys are unique, so range is empty or holds one element
+    template <bst_lookup<key_type> lookup_type = key_type>
+    std::pair<iterator, iterator> equal_range(const lookup_type &key) {
+        auto &&search_key = probe(key);
+        auto first = iterator(lower_bound_node(search_key), &root);
+        auto last = first;
+        if (last != end() && last->key == search_key) ++last;
+        return { first, last };
+    }
+
+    template <bst_lookup<key_type> lookup_type = key_type>
+    std::pair<const_iterator, const_iterator> equal_range(const lookup_type &key) const {
+        auto &&search_key = probe(key);
+        auto first = const_iterator(lower_bound_node(search_key), &root);
+        auto last = first;
+        if (last != end() && last->key == search_key) ++last;
+        return { first, last };
+    }
+
+    // Insert itself is variant specific try_emplace, everything below is
+    // built on it
+    tree_type & tree() {
+        return static_cast<tree_type &>(*this);
+    }
+
+    // Duplicate will be overridden
+    template <typename lookup_type = key_type, typename mapped_type = value_type>
+        requires bst_insert_key<lookup_type, key_type>
+    void insert(lookup_type &&key, mapped_type &&value) {
+        insert_or_assign(std::forward<lookup_type>(key), std::forward<mapped_type>(value));
+    }
+
+    // Value forwarded into a new node, or assigned to existing one. Second is
+    // true when a node was created.
+    template <typename lookup_type = key_type, typename mapped_type = value_type>
+        requires bst_insert_key<lookup_type, key_type>
+    std::pair<iterator, bool> insert_or_assign(lookup_type &&key, mapped_type &&value) {
+        auto result = tree().try_emplace(std::forward<lookup_type>(key), std::forward<mapped_type>(value));
+        if (!result.second) result.first->value = std::forward<mapped_type>(value);
+        return result;
+    }
+
+    // Value built in place from args only if key is missing, as std::map
+    // emplace an existing value is left untouched.
+    template <typename lookup_type = key_type, typename... args_type>
+        requires bst_insert_key<lookup_type, key_type>
+    std::pair<iterator, bool> emplace(lookup_type &&key, args_type &&... args) {
+        return tree().try_emplace(std::forward<lookup_type>(key), std::forward<args_type>(args)...);
+    }
+
+
+    // Tree of all keys of left, then key, then all keys of right, which must
+    // be in increasing order. Nodes of both move into result in
+    // O(|height(left) - height(right)|), right is left empty.
+    template <typename lookup_type = key_type, typename mapped_type = value_type>
+        requires joinable && bst_insert_key<lookup_type, key_type>
+    static tree_type join(tree_type &&left, lookup_type &&key, mapped_type &&value, tree_type &&right) {
+        auto node = left.create_node(std::forward<lookup_type>(key), std::forward<mapped_type>(value));
+        assert(left.root == nullptr || rightmost(left.root)->key < node->key);
+        assert(right.root == nullptr || node->key < leftmost(right.root)->key);
+        auto joined = left.join_subtrees(left.whole(), node, left.take_nodes(right));
+        left.finish(joined);
+        return std::move(left);
+    }
+
+    // Keys less than key stay, returned tree gets key and everything greater,
+    // in O(log n). Sizes of both trees come from subtree size, so split needs
+    // order_statistic. Returned tree is built from a copy of allocator, so a
+    // slab_allocator pool is shared by both trees.
+    tree_type split(const key_type &key) requires joinable && order_statistic_enabled {
+        auto split = split_subtree(tree().whole(), key);
+        if (split.node) split.right = tree().join_subtrees({ nullptr, 0 }, split.node, split.right);
+        tree_type result { allocator_type(node_allocator) };
+        tree().finish(split.left);
+        result.finish(split.right);
+        result.count = subtree_size(result.root);
+        count -= result.count;
+        return result;
+    }
+
+    // Set operations in O(m log(n / m + 1)) for sizes m <= n. Nodes of other
+    // are taken over or freed, other is left empty. Optional executor, such
+    // as thread_pool, runs independent halves in parallel.
+
+    // Split and join cost more per key than a plain insert, union by join
+    // wins only from about m = n / 4
+    static constexpr size_t union_insert_ratio = 4;
+
+    // Every key of either tree, value of other wins on duplicate key. Other
+    // much smaller than this tree is inserted key by key instead.
+    template <bst_executor executor_type = sequential_executor>
+        requires joinable
+    void union_with(tree_type &other, executor_type &&executor = { }) {
+        if (other.count * union_insert_ratio < count) {
+            for(auto &entry: other) tree().insert_or_assign(entry.key, std::move(entry.value));
+            other.clear();
+            return;
+        }
+        combine_with<set_operation::union_of>(other, executor, parallel_budget(executor));
+    }
+
+    // Keys present in both trees, with values of this tree
+    template <bst_executor executor_type = sequential_executor>
+        requires joinable
+    void intersection_with(tree_type &other, executor_type &&executor = { }) {
+        combine_with<set_operation::intersection>(other, executor, parallel_budget(executor));
+    }
+
+    // Keys of this tree not present in other
+    template <bst_executor executor_type = sequential_executor>
+        requires joinable
+    void difference_with(tree_type &other, executor_type &&executor = { }) {
+        combine_with<set_operation::difference>(other, executor, parallel_budget(executor));
+    }
+
+    iterator begin() {
+        return iterator(root ? leftmost(root) : nullptr, &root);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(root ? leftmost(root) : nullptr, &root);
+    }
+
+    iterator end() {
+        return iterator(nullptr, &root);
+    }
+
+    const_iterator end() const {
+        return const_iterator(nullptr, &root);
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Count of keys less than key
+    size_t rank(const key_type &key) const requires order_statistic_enabled {
+        size_t result = 0;
+        auto curr = root;
+        while(curr) {
+            if (curr->key < key) {
+                result += subtree_size(curr->left) + 1;
+                curr = curr->right;
+            } else {
+                curr = curr->left;
+            }
+        }
+        return result;
+    }
+
+    // Element at zero based position index in key order, end() if index is
+    // not less than size()
+    iterator select(size_t index) requires order_statistic_enabled {
+        return iterator(select_node(index), &root);
+    }
+
+    const_iterator select(size_t index) const requires order_statistic_enabled {
+        return const_iterator(select_node(index), &root);
+    }
+
+    // Count of keys in [low, high)
+    size_t count_range(const key_type &low, const key_type &high) const requires order_statistic_enabled {
+        if (!(low < high)) return 0;
+        return rank(high) - rank(low);
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    // Counters of a tree with augment_type with_stats, O(1). Red black trees
+    // walk left spine for black height in O(log n).
+    bst_stats stats() const requires stats_enabled {
+        bst_stats result;
+        result.lookups = counters.get(bst_counters::lookups);
+        result.lookup_visits = counters.get(bst_counters::lookup_visits);
+        // Every visited node is compared for equality, all but a hit for order
+        result.lookup_comparisons = 2 * result.lookup_visits - counters.get(bst_counters::lookup_hits);
+        result.insert_visits = counters.get(bst_counters::insert_visits);
+        result.rotations = counters.get(bst_counters::rotations);
+        result.color_flips = counters.get(bst_counters::color_flips);
+        result.allocations = counters.get(bst_counters::allocations);
+        result.deallocations = counters.get(bst_counters::deallocations);
+        result.size = count;
+        result.max_depth = counters.get(bst_counters::max_depth);
+        if constexpr (impl == blancing_type::avl) {
+            result.height_bound = root ? root->count : 0;
+        } else if constexpr (impl == blancing_type::none) {
+            result.height_bound = result.max_depth;
+        } else {
+            for(auto curr = root; curr != nullptr; curr = curr->left) result.black_height += !curr->red;
+            result.height_bound = 2 * result.black_height;
+        }
+        return result;
+    }
+
+    // Starts event counts again, max_depth is kept until clear()
+    void reset_stats() requires stats_enabled {
+        for(size_t index = 0; index < bst_counters::index_count; ++index) {
+            auto counter = static_cast<bst_counters::index_type>(index);
+            if (counter != bst_counters::max_depth) counters.set(counter, 0);
+        }
+    }
+
+    size_t depth() {
+        return depth(root);
+    }
+
 };
 
-template <typename key_type, typename value_type>
+template <typename key_type, typename value_type, typename augment_type, typename allocator_type>
     requires std::totally_ordered<key_type>
-class bst<key_type, value_type, blancing_type::none> :
-    public bst_base<key_type, value_type, blancing_type::none> {
+class bst<key_type, value_type, blancing_type::none, augment_type, allocator_type> :
+    public bst_base<key_type, value_type, blancing_type::none, augment_type, allocator_type> {
 public:
-    using base_type = bst_base<key_type, value_type, blancing_type::none>;
+    using base_type = bst_base<key_type, value_type, blancing_type::none, augment_type, allocator_type>;
     using node_type = base_type::node_type;
+    using base_type::base_type;
     using base_type::root;
+    using base_type::create_node;
+    using base_type::destroy_node;
+    using base_type::set_left;
+    using base_type::set_right;
+    using base_type::set_root;
+    using base_type::grow_ancestors;
+    using base_type::probe;
+    using base_type::shrink_ancestors;
+    using base_type::replace_augment;
+    using base_type::record;
+    using base_type::record_depth;
+    using iterator = base_type::iterator;
 
 public:
-    // Duplicate will be overridden
-    void insert(const key_type &key, const value_type &value) {
+    // Node with key and value built in place from args, only if key is not
+    // present. Existing element is left as it is, key and args are untouched.
+    template <typename lookup_type = key_type, typename... args_type>
+        requires bst_insert_key<lookup_type, key_type>
+    std::pair<iterator, bool> try_emplace(lookup_type &&lookup, args_type &&... args) {
+        auto &&key = probe(lookup);
         if (root == nullptr) {
-            root = new node_type(key, value);
-            return;
+            root = create_node(std::forward<lookup_type>(lookup), std::forward<args_type>(args)...);
+            record_depth(1);
+            return { iterator(root, &root), true };
         }
 
         auto curr = root;
+        size_t depth = 1;
         while(true) {
             if (curr->key == key) {
-                curr->value = value;
-                break;
+                record(bst_counters::insert_visits, depth);
+                return { iterator(curr, &root), false };
             }
 
-            if (key <= curr->key) {
+            if (key < curr->key) {
                 if (curr->left == nullptr) {
-                    curr->left = new node_type(key, value);
-                    break;
+                    set_left(curr, create_node(std::forward<lookup_type>(lookup), std::forward<args_type>(args)...));
+                    grow_ancestors(curr->left);
+                    record(bst_counters::insert_visits, depth);
+                    record_depth(depth + 1);
+                    return { iterator(curr->left, &root), true };
                 }
                 curr = curr->left;
             } else {
                 if (curr->right == nullptr) {
-                    curr->right = new node_type(key, value);
-                    break;
+                    set_right(curr, create_node(std::forward<lookup_type>(lookup), std::forward<args_type>(args)...));
+                    grow_ancestors(curr->right);
+                    record(bst_counters::insert_visits, depth);
+                    record_depth(depth + 1);
+                    return { iterator(curr->right, &root), true };
                 }
                 curr = curr->right;
             }
+            ++depth;
         }
     }
 
+    size_t erase(const key_type &key) {
+        auto node = base_type::locate(key);
+        if (node == nullptr) return 0;
+
+        erase(node);
+        return 1;
+    }
+
+    // Unbalanced tree can be as deep as it is long, so no recursion here.
+    // Node with two children is replaced by its successor node (relinked,
+    // not copied). Node is unlinked through its parent, no search by key.
+    void erase(node_type * node) {
+        auto link = base_type::link_of(node);
+        node_type *replacement;
+        if (node->left == nullptr) {
+            shrink_ancestors(node);
+            replacement = node->right;
+        } else if (node->right == nullptr) {
+            shrink_ancestors(node);
+            replacement = node->left;
+        } else {
+            auto successor = node->right;
+            while(successor->left != nullptr) {
+                successor = successor->left;
+            }
+            shrink_ancestors(successor);
+            replace_augment(successor, node);
+            if (successor != node->right) {
+                set_left(successor->parent, successor->right);
+                set_right(successor, node->right);
+            }
+            set_left(successor, node->left);
+            replacement = successor;
+        }
+
+        *link = replacement;
+        if (replacement != nullptr) replacement->parent = node->parent;
+        destroy_node(node);
+    }
+
+    // Returns iterator following erased element
+    iterator erase(iterator position) {
+        auto next = std::next(position);
+        erase(&*position);
+        return next;
+    }
+
 }; // class bst<key_type, value_type, blancing_type::none>
 
-template <typename key_type, typename value_type>
+template <typename key_type, typename value_type, typename augment_type>
     requires std::totally_ordered<key_type>
-struct bst_node<key_type, value_type, blancing_type::red_black> :
-    public bst_node_base<key_type, value_type>
+struct bst_node<key_type, value_type, blancing_type::red_black, augment_type> :
+    public bst_node_base<key_type, value_type>,
+    public bst_node_augment<augment_type>
 {
     using base_type = bst_node_base<key_type, value_type>;
     bool red = true; // By default it will start with red
 
     bst_node *left = nullptr;
     bst_node *right = nullptr;
+    bst_node *parent = nullptr;
 
-    bst_node(const key_type &key, const value_type &value) : base_type(key, value) { }
+    template <typename... args_type>
+    bst_node(std::in_place_t, args_type &&... args) : base_type(std::in_place, std::forward<args_type>(args)...) { }
 }; // struct bst_node<key_type, value_type, blancing_type::red_black>
 
-template <typename key_type, typename value_type>
-class bst<key_type, value_type, blancing_type::red_black> :
-    public bst_base<key_type, value_type, blancing_type::red_black> {
+template <typename key_type, typename value_type, typename augment_type, typename allocator_type>
+class bst<key_type, value_type, blancing_type::red_black, augment_type, allocator_type> :
+    public bst_base<key_type, value_type, blancing_type::red_black, augment_type, allocator_type> {
 public:
-    using base_type = bst_base<key_type, value_type, blancing_type::red_black>;
+    using base_type = bst_base<key_type, value_type, blancing_type::red_black, augment_type, allocator_type>;
     using node_type = base_type::node_type;
+    using base_type::base_type;
     using base_type::root;
+    using base_type::create_node;
+    using base_type::destroy_node;
+    using base_type::max_height;
+    using base_type::search_path;
+    using base_type::set_left;
+    using base_type::set_right;
+    using base_type::set_root;
+    using base_type::update_size;
+    using base_type::grow_ancestors;
+    using base_type::probe;
+    using base_type::shrink_ancestors;
+    using base_type::replace_augment;
+    using base_type::record;
+    using iterator = base_type::iterator;
 
 private:
-    node_type * insert_recursive(node_type * root, const key_type &key, const value_type &value) {
-        if (root->key == key) {
-            root->value = value;
-            return root;
+    friend base_type;
+    using subtree = base_type::subtree;
+
+    static bool is_red(node_type * _root) {
+        return _root != nullptr && _root->red;
+    }
+
+    // New subtree root takes over parent of _root
+    node_type * rotate_left(node_type * _root) {
+        auto right = _root->right;
+        set_right(_root, right->left);
+        right->parent = _root->parent;
+        set_left(right, _root);
+        update_size(_root);
+        update_size(right);
+        record(bst_counters::rotations);
+        return right;
+    }
+
+    node_type * rotate_right(node_type * _root) {
+        auto left = _root->left;
+        set_left(_root, left->right);
+        left->parent = _root->parent;
+        set_right(left, _root);
+        update_size(_root);
+        update_size(left);
+        record(bst_counters::rotations);
+        return left;
+    }
+
+    // Left subtree of _root lost one black, sibling is on the right.
+    // shrunk is set if whole subtree lost one black as well.
+    node_type * fix_left(node_type * _root, bool &shrunk) {
+        auto sibling = _root->right;
+        shrunk = false;
+        if (sibling->red) {
+            // Red sibling is rotated up, _root turns red and is fixed below it
+            _root = rotate_left(_root);
+            _root->red = false;
+            _root->left->red = true;
+            bool inner_shrunk;
+            set_left(_root, fix_left(_root->left, inner_shrunk));
+            assert(!inner_shrunk);
+            return _root;
         }
 
-        if (key <= root->key) {
-            if (root->left == nullptr) {
-                root->left = new node_type(key, value);
-            } else {
-                auto left = insert_recursive(root->left, key, value);
-                if (left->red) {
-                    if (left->left != nullptr && left->left->red) {
-                        assert(!root->red);
-                        // left -> left rotation
-                        root->left = left->right;
-                        left->right = root;
-                        left->left->red = false;
-                        root = left;
-                    } else if (left->right != nullptr && left->right->red) {
-                        assert(!root->red);
-                        // left -> right rotation
-                        auto leftright = left->right;
-                        root->left = leftright->right;
-                        left->right = leftright->left;
-                        leftright->left = left;
-                        leftright->right = root;
-                        left->red = false;
-                        root = leftright;
-                    } else root->left = left;
-                } // else root->left = left; // Not required
+        if (!is_red(sibling->left) && !is_red(sibling->right)) {
+            sibling->red = true;
+            record(bst_counters::color_flips);
+            if (_root->red) _root->red = false;
+            else shrunk = true;
+            return _root;
+        }
+
+        if (!is_red(sibling->right)) {
+            // right -> left case, turn it into right -> right
+            set_right(_root, rotate_right(sibling));
+            _root->right->red = false;
+            sibling->red = true;
+        }
+
+        auto color = _root->red;
+        _root = rotate_left(_root);
+        _root->red = color;
+        _root->left->red = false;
+        _root->right->red = false;
+        return _root;
+    }
+
+    // Mirror of fix_left
+    node_type * fix_right(node_type * _root, bool &shrunk) {
+        auto sibling = _root->left;
+        shrunk = false;
+        if (sibling->red) {
+            _root = rotate_right(_root);
+            _root->red = false;
+            _root->right->red = true;
+            bool inner_shrunk;
+            set_right(_root, fix_right(_root->right, inner_shrunk));
+            assert(!inner_shrunk);
+            return _root;
+        }
+
+        if (!is_red(sibling->left) && !is_red(sibling->right)) {
+            sibling->red = true;
+            record(bst_counters::color_flips);
+            if (_root->red) _root->red = false;
+            else shrunk = true;
+            return _root;
+        }
+
+        if (!is_red(sibling->left)) {
+            set_left(_root, rotate_left(sibling));
+            _root->left->red = false;
+            sibling->red = true;
+        }
+
+        auto color = _root->red;
+        _root = rotate_right(_root);
+        _root->red = color;
+        _root->left->red = false;
+        _root->right->red = false;
+        return _root;
+    }
+
+    // Join support for bst_base, subtree height is black height: count of
+    // black nodes on any path down from and including root
+
+    subtree whole() const {
+        int height = 0;
+        for(auto curr = root; curr != nullptr; curr = curr->left) height += !curr->red;
+        return { root, height };
+    }
+
+    static std::pair<subtree, subtree> children(subtree tree) {
+        auto height = tree.height - !tree.root->red;
+        return { { tree.root->left, height }, { tree.root->right, height } };
+    }
+
+    static node_type * compose(node_type * left, node_type * middle, node_type * right, bool red) {
+        set_left(middle, left);
+        set_right(middle, right);
+        middle->red = red;
+        update_size(middle);
+        return middle;
+    }
+
+    // Walks right spine of left down to a black node of black height of
+    // right, red-red left on the way up is fixed by a rotation one level up.
+    // Result keeps black height of left, root may be red with red right child.
+    node_type * join_right(node_type * left, int left_height, node_type * middle, node_type * right, int right_height) {
+        if (!is_red(left) && left_height == right_height) return compose(left, middle, right, true);
+        set_right(left, join_right(left->right, left_height - !left->red, middle, right, right_height));
+        update_size(left);
+        if (!left->red && is_red(left->right) && is_red(left->right->right)) {
+            left->right->right->red = false;
+            return rotate_left(left);
+        }
+        return left;
+    }
+
+    node_type * join_left(node_type * left, int left_height, node_type * middle, node_type * right, int right_height) {
+        if (!is_red(right) && left_height == right_height) return compose(left, middle, right, true);
+        set_left(right, join_left(left, left_height, middle, right->left, right_height - !right->red));
+        update_size(right);
+        if (!right->red && is_red(right->left) && is_red(right->left->left)) {
+            right->left->left->red = false;
+            return rotate_right(right);
+        }
+        return right;
+    }
+
+    subtree join_subtrees(subtree left, node_type * middle, subtree right) {
+        if (left.height > right.height) {
+            auto result = join_right(left.root, left.height, middle, right.root, right.height);
+            if (result->red && is_red(result->right)) {
+                result->red = false;
+                return { result, left.height + 1 };
             }
-        } else {
-            if (root->right == nullptr) {
-                root->right = new node_type(key, value);
-            } else {
-                auto right = insert_recursive(root->right, key, value);
-                if (right->red) {
-                    if (right->right != nullptr && right->right->red) {
-                        assert(!root->red);
-                        // right -> right rotation
-                        root->right = right->left;
-                        right->left = root;
-                        root = right;
-                        right->right->red = false;
-                    } else if (right->left != nullptr && right->left->red) {
-                        assert(!root->red);
-                        // right -> left rotation
-                        auto rightleft = right->left;
-                        root->right = rightleft->left;
-                        right->left = rightleft->right;
-                        rightleft->right = right;
-                        rightleft->left = root;
-                        right->red = false;
-                        root = rightleft;
-                    } else root->right = right;
-                } // else root->right = right; // Not required
+            return { result, left.height };
+        }
+        if (right.height > left.height) {
+            auto result = join_left(left.root, left.height, middle, right.root, right.height);
+            if (result->red && is_red(result->left)) {
+                result->red = false;
+                return { result, right.height + 1 };
             }
+            return { result, right.height };
         }
+        if (!is_red(left.root) && !is_red(right.root)) return { compose(left.root, middle, right.root, true), left.height };
+        return { compose(left.root, middle, right.root, false), left.height + 1 };
+    }
 
-        if (root->left != nullptr && root->right != nullptr && root->left->red && root->right->red) {
-            assert(!root->red);
-            root->red = true;
-            root->left->red = root->right->red = false;
-        }
+    void finish(subtree tree) {
+        set_root(tree.root);
+        if (root) root->red = false;
+    }
 
-        return root;
+    // Node with at most one child is replaced by that child, child can only
+    // be red so it takes over the black of removed node.
+    static node_type * unlink(node_type * _root, bool &shrunk) {
+        shrink_ancestors(_root);
+        auto child = _root->left != nullptr ? _root->left : _root->right;
+        shrunk = false;
+        if (_root->red) return child;
+        if (child != nullptr) child->red = false;
+        else shrunk = true;
+        return child;
     }
 
 public:
-    // Duplicate will be overridden
-    void insert(const key_type &key, const value_type &value) {
-        if (root == nullptr) {
-            root = new node_type(key, value);
-            root->red = false;
-            return;
+    // Same contract as bst<none>::try_emplace. Bottom up insert walking back
+    // over saved links, stops at first black parent or after a rotation.
+    template <typename lookup_type = key_type, typename... args_type>
+        requires bst_insert_key<lookup_type, key_type>
+    std::pair<iterator, bool> try_emplace(lookup_type &&lookup, args_type &&... args) {
+        auto &&key = probe(lookup);
+        node_type **path[max_height];
+        size_t depth;
+        auto link = search_path(key, path, depth);
+        if (*link != nullptr) {
+            return { iterator(*link, &root), false };
         }
 
-        auto newroot = insert_recursive(root, key, value);
-        if (newroot->red) {
-            root = newroot;
-            root->red = false;
+        auto created = create_node(std::forward<lookup_type>(lookup), std::forward<args_type>(args)...);
+        *link = created;
+        if (depth > 0) created->parent = *path[depth - 1];
+        grow_ancestors(created);
+        while(depth >= 2) {
+            auto parent = *path[depth - 1];
+            if (!parent->red) break;
+
+            auto grand_link = path[depth - 2];
+            auto grand = *grand_link;
+            auto node = *link;
+            if (grand->left == parent) {
+                auto uncle = grand->right;
+                if (is_red(uncle)) {
+                    // Split 4-node and continue from grand parent
+                    parent->red = uncle->red = false;
+                    grand->red = true;
+                    record(bst_counters::color_flips);
+                    link = grand_link;
+                    depth -= 2;
+                    continue;
+                }
+                // left -> right becomes left -> left
+                if (parent->right == node) set_left(grand, rotate_left(parent));
+                *grand_link = rotate_right(grand);
+            } else {
+                auto uncle = grand->left;
+                if (is_red(uncle)) {
+                    parent->red = uncle->red = false;
+                    grand->red = true;
+                    record(bst_counters::color_flips);
+                    link = grand_link;
+                    depth -= 2;
+                    continue;
+                }
+                if (parent->left == node) set_right(grand, rotate_right(parent));
+                *grand_link = rotate_left(grand);
+            }
+            (*grand_link)->red = false;
+            grand->red = true;
+            break;
         }
+        root->red = false;
+        return { iterator(created, &root), true };
+    }
+
+    size_t erase(const key_type &key) {
+        auto node = base_type::locate(key);
+        if (node == nullptr) return 0;
+
+        erase(node);
+        return 1;
+    }
+
+    // Bottom up delete from node through parent pointers, fix up walks back
+    // only while black height is short
+    void erase(node_type * node) {
+        node_type *parent;
+        bool left_side;
+        bool shrunk;
+        if (node->left != nullptr && node->right != nullptr) {
+            // Successor node takes place and colour of erased node
+            auto successor = node->right;
+            while(successor->left != nullptr) successor = successor->left;
+            parent = successor->parent;
+            left_side = parent != node;
+            auto child = unlink(successor, shrunk);
+            if (left_side) set_left(parent, child);
+            else set_right(node, child);
+            *base_type::link_of(node) = successor;
+            successor->parent = node->parent;
+            set_left(successor, node->left);
+            set_right(successor, node->right);
+            successor->red = node->red;
+            replace_augment(successor, node);
+            if (!left_side) parent = successor;
+        } else {
+            parent = node->parent;
+            left_side = parent != nullptr && parent->left == node;
+            auto child = unlink(node, shrunk);
+            *base_type::link_of(node) = child;
+            if (child != nullptr) child->parent = parent;
+        }
+
+        while(shrunk && parent != nullptr) {
+            auto link = base_type::link_of(parent);
+            auto grand = parent->parent;
+            auto grand_side = grand != nullptr && grand->left == parent;
+            *link = left_side ? fix_left(parent, shrunk) : fix_right(parent, shrunk);
+            parent = grand;
+            left_side = grand_side;
+        }
+        if (root != nullptr) root->red = false;
+        destroy_node(node);
+    }
+
+    // Returns iterator following erased element
+    iterator erase(iterator position) {
+        auto next = std::next(position);
+        erase(&*position);
+        return next;
     }
 }; // class bst<key_type, value_type, blancing_type::red_black>
 
-template <typename key_type, typename value_type>
+template <typename key_type, typename value_type, typename augment_type>
     requires std::totally_ordered<key_type>
-struct bst_node<key_type, value_type, blancing_type::red_black_leftleaning> :
-    public bst_node_base<key_type, value_type>
+struct bst_node<key_type, value_type, blancing_type::red_black_leftleaning, augment_type> :
+    public bst_node_base<key_type, value_type>,
+    public bst_node_augment<augment_type>
 {
     using base_type = bst_node_base<key_type, value_type>;
     bool red = true; // By default it will start with red
 
     bst_node *left = nullptr;
     bst_node *right = nullptr;
+    bst_node *parent = nullptr;
 
-    bst_node(const key_type &key, const value_type &value) : base_type(key, value) { }
+    template <typename... args_type>
+    bst_node(std::in_place_t, args_type &&... args) : base_type(std::in_place, std::forward<args_type>(args)...) { }
 }; // struct bst_node<key_type, value_type, blancing_type::red_black_leftleaning>
 
-template <typename key_type, typename value_type>
-class bst<key_type, value_type, blancing_type::red_black_leftleaning> :
-    public bst_base<key_type, value_type, blancing_type::red_black_leftleaning> {
+template <typename key_type, typename value_type, typename augment_type, typename allocator_type>
+class bst<key_type, value_type, blancing_type::red_black_leftleaning, augment_type, allocator_type> :
+    public bst_base<key_type, value_type, blancing_type::red_black_leftleaning, augment_type, allocator_type> {
 public:
-    using base_type = bst_base<key_type, value_type, blancing_type::red_black_leftleaning>;
+    using base_type = bst_base<key_type, value_type, blancing_type::red_black_leftleaning, augment_type, allocator_type>;
     using node_type = base_type::node_type;
+    using base_type::base_type;
     using base_type::root;
+    using base_type::create_node;
+    using base_type::destroy_node;
+    using base_type::max_height;
+    using base_type::search_path;
+    using base_type::set_left;
+    using base_type::set_right;
+    using base_type::set_root;
+    using base_type::update_size;
+    using base_type::grow_ancestors;
+    using base_type::probe;
+    using base_type::shrink_ancestors;
+    using base_type::replace_augment;
+    using base_type::record;
+    using iterator = base_type::iterator;
 
 private:
 
@@ -282,83 +1727,221 @@ private:
         return _root->red;
     }
 
+    // Insert splits a 4-node (black with two red children), erase merges
+    // into one (red with two black children)
     void flip_color(node_type * _root) {
-        assert(!_root->red);
-        assert(_root->left->red);
-        assert(_root->right->red);
-        _root->red = true;
-        _root->left->red = false;
-        _root->right->red = false;
+        assert(_root->left->red == _root->right->red);
+        assert(_root->red != _root->left->red);
+        _root->red = !_root->red;
+        _root->left->red = !_root->left->red;
+        _root->right->red = !_root->right->red;
+        record(bst_counters::color_flips);
     }
 
+    // New subtree root takes over colour and parent of _root
     node_type * rotate_left(node_type * _root) {
         auto right = _root->right;
-        _root->right = right->left;
-        right->left = _root;
+        set_right(_root, right->left);
+        right->parent = _root->parent;
+        set_left(right, _root);
+        update_size(_root);
+        update_size(right);
         right->red = _root->red;
         _root->red = true;
+        record(bst_counters::rotations);
 
         assert(right != nullptr);
         return right;
     }
 
     node_type * rotate_right(node_type * _root) {
-        assert(!_root->red);
         auto left = _root->left;
-        _root->left = left->right;
-        left->right = _root;
-        left->red = true;
-        left->left->red = false;
+        set_left(_root, left->right);
+        left->parent = _root->parent;
+        set_right(left, _root);
+        update_size(_root);
+        update_size(left);
+        left->red = _root->red;
+        _root->red = true;
+        record(bst_counters::rotations);
 
         assert(left != nullptr);
         return left;
     }
 
-    node_type * insert_recursive(node_type * _root, const key_type &key, const value_type &value) {
-        if (_root == nullptr) return new node_type(key, value);
-        if (key < _root->key) _root->left = insert_recursive(_root->left, key, value);
-        else if (key > _root->key) _root->right = insert_recursive(_root->right, key, value);
-        else _root->value = value;
-
+    node_type * balance(node_type * _root) {
         if (is_red(_root->right) && !is_red(_root->left)) _root = rotate_left(_root);
         if (is_red(_root->left) && is_red(_root->left->left)) _root = rotate_right(_root);
         if (is_red(_root->left) && is_red(_root->right)) flip_color(_root);
+        return _root;
+    }
 
+    // Borrows from right sibling so that left child or its left is red
+    node_type * move_red_left(node_type * _root) {
+        flip_color(_root);
+        if (is_red(_root->right->left)) {
+            set_right(_root, rotate_right(_root->right));
+            _root = rotate_left(_root);
+            flip_color(_root);
+        }
         return _root;
     }
 
+    node_type * move_red_right(node_type * _root) {
+        flip_color(_root);
+        if (is_red(_root->left->left)) {
+            _root = rotate_right(_root);
+            flip_color(_root);
+        }
+        return _root;
+    }
+
+    // Left most node is removed from tree but not destroyed
+    node_type * detach_min(node_type * _root, node_type *&min) {
+        if (_root->left == nullptr) {
+            shrink_ancestors(_root);
+            min = _root;
+            return nullptr;
+        }
+        if (!is_red(_root->left) && !is_red(_root->left->left)) _root = move_red_left(_root);
+        set_left(_root, detach_min(_root->left, min));
+        return balance(_root);
+    }
+
+    // Top down delete, erased is left nullptr when key is not in the tree.
+    // Nodes moved on the way down to a missing key are put back by balance.
+    node_type * erase_recursive(node_type * _root, const key_type &key, node_type *&erased) {
+        if (key < _root->key) {
+            if (_root->left == nullptr) return balance(_root);
+            if (!is_red(_root->left) && !is_red(_root->left->left)) _root = move_red_left(_root);
+            set_left(_root, erase_recursive(_root->left, key, erased));
+        } else {
+            if (is_red(_root->left)) _root = rotate_right(_root);
+            if (_root->right == nullptr) {
+                if (_root->key < key) return balance(_root);
+                shrink_ancestors(_root);
+                erased = _root;
+                return nullptr;
+            }
+            if (!is_red(_root->right) && !is_red(_root->right->left)) _root = move_red_right(_root);
+            if (!(_root->key < key)) {
+                // Successor node takes place and colour of erased node
+                node_type *successor;
+                auto right = detach_min(_root->right, successor);
+                set_left(successor, _root->left);
+                set_right(successor, right);
+                successor->parent = _root->parent;
+                replace_augment(successor, _root);
+                successor->red = _root->red;
+                erased = _root;
+                _root = successor;
+            } else {
+                set_right(_root, erase_recursive(_root->right, key, erased));
+            }
+        }
+        return balance(_root);
+    }
+
 public:
-    // Duplicate will be overridden
-    void insert(const key_type &key, const value_type &value) {
-        root = insert_recursive(root, key, value);
+    // Same contract as bst<none>::try_emplace. balance() is applied over
+    // saved links bottom up, once a subtree root stays black nothing above
+    // changes.
+    template <typename lookup_type = key_type, typename... args_type>
+        requires bst_insert_key<lookup_type, key_type>
+    std::pair<iterator, bool> try_emplace(lookup_type &&lookup, args_type &&... args) {
+        auto &&key = probe(lookup);
+        node_type **path[max_height];
+        size_t depth;
+        auto link = search_path(key, path, depth);
+        if (*link != nullptr) {
+            return { iterator(*link, &root), false };
+        }
+
+        auto created = create_node(std::forward<lookup_type>(lookup), std::forward<args_type>(args)...);
+        *link = created;
+        if (depth > 0) created->parent = *path[depth - 1];
+        grow_ancestors(created);
+        while(depth > 0) {
+            link = path[--depth];
+            *link = balance(*link);
+            if (!(*link)->red) break;
+        }
         root->red = false;
+        return { iterator(created, &root), true };
+    }
+
+    size_t erase(const key_type &key) {
+        if (root == nullptr) return 0;
+
+        if (!is_red(root->left) && !is_red(root->right)) root->red = true;
+        node_type *erased = nullptr;
+        set_root(erase_recursive(root, key, erased));
+        if (root != nullptr) root->red = false;
+        if (erased == nullptr) return 0;
+
+        destroy_node(erased);
+        return 1;
+    }
+
+    // Top down delete has to restructure every level above node, so node is
+    // reached by its key in that single pass
+    void erase(node_type * node) {
+        erase(node->key);
+    }
+
+    // Returns iterator following erased element
+    iterator erase(iterator position) {
+        auto next = std::next(position);
+        erase(&*position);
+        return next;
     }
 }; // class bst<key_type, value_type, blancing_type::red_black_leftleaning>
 
-template <typename key_type, typename value_type>
+template <typename key_type, typename value_type, typename augment_type>
     requires std::totally_ordered<key_type>
-struct bst_node<key_type, value_type, blancing_type::avl> :
-    public bst_node_base<key_type, value_type>
+struct bst_node<key_type, value_type, blancing_type::avl, augment_type> :
+    public bst_node_base<key_type, value_type>,
+    public bst_node_augment<augment_type>
 {
     using base_type = bst_node_base<key_type, value_type>;
     int count = 1; // initial count is always one
 
     bst_node *left = nullptr;
     bst_node *right = nullptr;
+    bst_node *parent = nullptr;
 
-    bst_node(const key_type &key, const value_type &value) : base_type(key, value) { }
+    template <typename... args_type>
+    bst_node(std::in_place_t, args_type &&... args) : base_type(std::in_place, std::forward<args_type>(args)...) { }
 }; // struct bst_node<key_type, value_type, blancing_type::red_black>
 
 
-template <typename key_type, typename value_type>
-class bst<key_type, value_type, blancing_type::avl> :
-    public bst_base<key_type, value_type, blancing_type::avl> {
+template <typename key_type, typename value_type, typename augment_type, typename allocator_type>
+class bst<key_type, value_type, blancing_type::avl, augment_type, allocator_type> :
+    public bst_base<key_type, value_type, blancing_type::avl, augment_type, allocator_type> {
 public:
-    using base_type = bst_base<key_type, value_type, blancing_type::avl>;
+    using base_type = bst_base<key_type, value_type, blancing_type::avl, augment_type, allocator_type>;
     using node_type = base_type::node_type;
+    using base_type::base_type;
     using base_type::root;
+    using base_type::create_node;
+    using base_type::destroy_node;
+    using base_type::max_height;
+    using base_type::search_path;
+    using base_type::set_left;
+    using base_type::set_right;
+    using base_type::set_root;
+    using base_type::update_size;
+    using base_type::grow_ancestors;
+    using base_type::probe;
+    using base_type::shrink_ancestors;
+    using base_type::replace_augment;
+    using base_type::record;
+    using iterator = base_type::iterator;
 
 private:
+    friend base_type;
+    using subtree = base_type::subtree;
+
     int child_count_diff(node_type * _root) {
         int left = _root->left ? _root->left->count : 0;
         int right = _root->right ? _root->right->count : 0;
@@ -375,10 +1958,14 @@ private:
     //            c
     node_type * rotate_left(node_type * _root) {
         auto right = _root->right;
-        _root->right = right->left;
-        right->left = _root;
+        set_right(_root, right->left);
+        right->parent = _root->parent;
+        set_left(right, _root);
+        update_size(_root);
+        update_size(right);
         update_count(_root);
         update_count(right);
+        record(bst_counters::rotations);
         assert(right != nullptr);
         return right;
     }
@@ -388,10 +1975,14 @@ private:
     //    c
     node_type * rotate_right(node_type * _root) {
         auto left = _root->left;
-        _root->left = left->right;
-        left->right = _root;
-        update_count(root);
+        set_left(_root, left->right);
+        left->parent = _root->parent;
+        set_right(left, _root);
+        update_size(_root);
+        update_size(left);
+        update_count(_root);
         update_count(left);
+        record(bst_counters::rotations);
         assert(left != nullptr);
         return left;
     }
@@ -401,13 +1992,18 @@ private:
     //      c
     node_type * rotate_right_left(node_type * _root) {
         auto newroot = _root->right->left;
-        _root->right->left = newroot->right;
-        newroot->right = _root->right;
-        _root->right = newroot->left;
-        newroot->left = _root;
+        newroot->parent = _root->parent;
+        set_left(_root->right, newroot->right);
+        set_right(newroot, _root->right);
+        set_right(_root, newroot->left);
+        set_left(newroot, _root);
+        update_size(newroot->left);
+        update_size(newroot->right);
+        update_size(newroot);
         update_count(newroot->left);
         update_count(newroot->right);
         update_count(newroot);
+        record(bst_counters::rotations, 2);
         return newroot;
     }
 
@@ -416,34 +2012,179 @@ private:
     //          c
     node_type * rotate_left_right(node_type * _root) {
         auto newroot = _root->left->right;
-        _root->left->right = newroot->left;
-        newroot->left = root->left;
-        _root->left = newroot->right;
-        newroot->right = _root;
+        newroot->parent = _root->parent;
+        set_right(_root->left, newroot->left);
+        set_left(newroot, _root->left);
+        set_left(_root, newroot->right);
+        set_right(newroot, _root);
+        update_size(newroot->left);
+        update_size(newroot->right);
+        update_size(newroot);
         update_count(newroot->left);
         update_count(newroot->right);
         update_count(newroot);
+        record(bst_counters::rotations, 2);
         return newroot;
     }
 
-    node_type * insert_recursive(node_type * _root, const key_type &key, const value_type &value) {
-        if (_root == nullptr) return new node_type(key, value);
-        if (key < _root->key) _root->left = insert_recursive(_root->left, key, value);
-        else if (key > _root->key) _root->right = insert_recursive(_root->right, key, value);
-        else _root->value = value;
-    
+    // Heavy child leaning the other way needs double rotation
+    node_type * balance(node_type * _root) {
         auto count_diff = child_count_diff(_root);
-        if (count_diff <= -2) _root = rotate_left(_root);
-        else if (count_diff >= 2) _root = rotate_right(_root);
-        else update_count(_root);
-
+        if (count_diff <= -2) {
+            if (child_count_diff(_root->right) > 0) return rotate_right_left(_root);
+            return rotate_left(_root);
+        }
+        if (count_diff >= 2) {
+            if (child_count_diff(_root->left) < 0) return rotate_left_right(_root);
+            return rotate_right(_root);
+        }
+        update_count(_root);
         return _root;
     }
 
+    // Join support for bst_base, subtree height is avl height kept in count
+
+    static int height(node_type * _root) {
+        return _root ? _root->count : 0;
+    }
+
+    subtree whole() const {
+        return { root, height(root) };
+    }
+
+    static std::pair<subtree, subtree> children(subtree tree) {
+        return { { tree.root->left, height(tree.root->left) }, { tree.root->right, height(tree.root->right) } };
+    }
+
+    node_type * compose(node_type * left, node_type * middle, node_type * right) {
+        set_left(middle, left);
+        set_right(middle, right);
+        update_size(middle);
+        update_count(middle);
+        return middle;
+    }
+
+    // Walks right spine of left down to a subtree at most one higher than
+    // right, one single or double rotation per level on the way up
+    node_type * join_right(node_type * left, node_type * middle, node_type * right) {
+        auto inner = left->right;
+        if (height(inner) <= height(right) + 1) {
+            auto joined = compose(inner, middle, right);
+            if (joined->count <= height(left->left) + 1) return compose(left->left, left, joined);
+            set_right(left, rotate_right(joined));
+            return rotate_left(left);
+        }
+        auto joined = join_right(inner, middle, right);
+        compose(left->left, left, joined);
+        if (joined->count <= height(left->left) + 1) return left;
+        return rotate_left(left);
+    }
+
+    node_type * join_left(node_type * left, node_type * middle, node_type * right) {
+        auto inner = right->left;
+        if (height(inner) <= height(left) + 1) {
+            auto joined = compose(left, middle, inner);
+            if (joined->count <= height(right->right) + 1) return compose(joined, right, right->right);
+            set_left(right, rotate_left(joined));
+            return rotate_right(right);
+        }
+        auto joined = join_left(left, middle, inner);
+        compose(joined, right, right->right);
+        if (joined->count <= height(right->right) + 1) return right;
+        return rotate_right(right);
+    }
+
+    subtree join_subtrees(subtree left, node_type * middle, subtree right) {
+        node_type *result;
+        if (left.height > right.height + 1) result = join_right(left.root, middle, right.root);
+        else if (right.height > left.height + 1) result = join_left(left.root, middle, right.root);
+        else result = compose(left.root, middle, right.root);
+        return { result, result->count };
+    }
+
+    void finish(subtree tree) {
+        set_root(tree.root);
+    }
+
 public:
-    // Duplicate will be overridden
-    void insert(const key_type &key, const value_type &value) {
-        root = insert_recursive(root, key, value);
+    // Same contract as bst<none>::try_emplace. Ancestors are rebalanced over
+    // saved links until one keeps its height, at most one rotation is needed.
+    template <typename lookup_type = key_type, typename... args_type>
+        requires bst_insert_key<lookup_type, key_type>
+    std::pair<iterator, bool> try_emplace(lookup_type &&lookup, args_type &&... args) {
+        auto &&key = probe(lookup);
+        node_type **path[max_height];
+        size_t depth;
+        auto link = search_path(key, path, depth);
+        if (*link != nullptr) {
+            return { iterator(*link, &root), false };
+        }
+
+        auto created = create_node(std::forward<lookup_type>(lookup), std::forward<args_type>(args)...);
+        *link = created;
+        if (depth > 0) created->parent = *path[depth - 1];
+        grow_ancestors(created);
+        while(depth > 0) {
+            link = path[--depth];
+            auto height = (*link)->count;
+            *link = balance(*link);
+            if ((*link)->count == height) break;
+        }
+        return { iterator(created, &root), true };
+    }
+
+    size_t erase(const key_type &key) {
+        auto node = base_type::locate(key);
+        if (node == nullptr) return 0;
+
+        erase(node);
+        return 1;
+    }
+
+    // Node is unlinked through its parent pointer, ancestors are rebalanced
+    // bottom up until one keeps its height
+    void erase(node_type * node) {
+        node_type *parent;
+        if (node->left != nullptr && node->right != nullptr) {
+            // Successor node takes place and height of erased node
+            auto successor = node->right;
+            while(successor->left != nullptr) successor = successor->left;
+            shrink_ancestors(successor);
+            parent = successor;
+            if (successor != node->right) {
+                parent = successor->parent;
+                set_left(parent, successor->right);
+                set_right(successor, node->right);
+            }
+            set_left(successor, node->left);
+            *base_type::link_of(node) = successor;
+            successor->parent = node->parent;
+            successor->count = node->count;
+            replace_augment(successor, node);
+        } else {
+            shrink_ancestors(node);
+            parent = node->parent;
+            auto child = node->left != nullptr ? node->left : node->right;
+            *base_type::link_of(node) = child;
+            if (child != nullptr) child->parent = parent;
+        }
+
+        while(parent != nullptr) {
+            auto link = base_type::link_of(parent);
+            auto height = parent->count;
+            auto grand = parent->parent;
+            *link = balance(parent);
+            if ((*link)->count == height) break;
+            parent = grand;
+        }
+        destroy_node(node);
+    }
+
+    // Returns iterator following erased element
+    iterator erase(iterator position) {
+        auto next = std::next(position);
+        erase(&*position);
+        return next;
     }
 }; // class bst<key_type, value_type, blancing_type::avl>
 
@@ -24,48 +24,51 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 namespace rohit {
 
-template <typename key_type, typename value_type, blancing_type impl>
-void display_inorder(bst_node<key_type, value_type, impl> *root) {
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type>
+void display_inorder(bst_node<key_type, value_type, impl, augment_type> *root) {
     if (root == nullptr) return;
     display_inorder(root->left);
     std::cout << root->key << " ";
     display_inorder(root->right);
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-void display_inorder(bst<key_type, value_type, impl> &bst) {
-    auto list = inorder(bst);
-    std::vector<key_type> key_list;
-    std::ranges::copy(std::views::transform(list, [](auto &val) { return val.first; }), std::back_inserter(key_list));
-    std::cout << key_list;
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+void display_inorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    const char *separator = "";
+    visit_inorder(bst, [&](auto &node) {
+        std::cout << separator << node.key;
+        separator = " ";
+    });
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-void display_postorder(bst_node<key_type, value_type, impl> *root) {
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type>
+void display_postorder(bst_node<key_type, value_type, impl, augment_type> *root) {
     if (root == nullptr) return;
     display_postorder(root->left);
     display_postorder(root->right);
     std::cout << root->key << " ";
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-void display_postorder(bst<key_type, value_type, impl> &bst) {
-    auto list = postorder(bst);
-    std::vector<key_type> key_list;
-    std::ranges::copy(std::views::transform(list, [](auto &val) { return val.first; }), std::back_inserter(key_list));
-    std::cout << key_list;
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+void display_postorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    const char *separator = "";
+    visit_postorder(bst, [&](auto &node) {
+        std::cout << separator << node.key;
+        separator = " ";
+    });
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-void display_preorder(bst<key_type, value_type, impl> &bst) {
-    auto list = preorder(bst);
-    std::vector<key_type> key_list;
-    std::ranges::copy(std::views::transform(list, [](auto &val) { return val.first; }), std::back_inserter(key_list));
-    std::cout << key_list;
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+void display_preorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    const char *separator = "";
+    visit_preorder(bst, [&](auto &node) {
+        std::cout << separator << node.key;
+        separator = " ";
+    });
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-size_t display_tree(bst_node<key_type, value_type, impl> *root, std::vector<std::string> &lines, size_t depth, size_t maxdepth, size_t minwidth) {
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type>
+size_t display_tree(bst_node<key_type, value_type, impl, augment_type> *root, std::vector<std::string> &lines, size_t depth, size_t maxdepth, size_t minwidth) {
     if (root == nullptr) {
         while(depth < maxdepth) {
             auto &line = lines[depth++];
@@ -102,8 +105,8 @@ size_t display_tree(bst_node<key_type, value_type, impl> *root, std::vector<std:
     return width;
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-void display_tree(bst<key_type, value_type, impl> &bst) {
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+void display_tree(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
     auto depth = bst.depth();
     std::vector<std::string> lines;
     for(size_t count = 0; count < depth; ++count) {
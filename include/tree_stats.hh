@@ -0,0 +1,122 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace rohit {
+
+// Statistics policy, given to bst as augment_type around node augmentation:
+// bst<key, value, impl, with_stats<>> or with_stats<order_statistic>. Nodes
+// are same as with wrapped augmentation, counters are kept once per tree.
+// Without it nothing is counted and no code is generated.
+template <typename augment_type>
+struct with_stats { };
+
+// Node augmentation once policy wrappers are removed
+template <typename augment_type>
+struct bst_augment {
+    using type = augment_type;
+    static constexpr bool stats = false;
+};
+
+template <typename augment_type>
+struct bst_augment<with_stats<augment_type>> {
+    using type = augment_type;
+    static constexpr bool stats = true;
+};
+
+// Snapshot returned by bst::stats(). Counts are events since tree was
+// created or reset_stats() was called. Per insert and per lookup figures
+// are ratios, rotations / allocations or lookup_comparisons / lookups.
+struct bst_stats {
+    uint64_t lookups = 0;               // find and find_batch keys
+    uint64_t lookup_visits = 0;         // Nodes visited by lookups
+    uint64_t lookup_comparisons = 0;    // Key comparisons made by lookups
+    uint64_t insert_visits = 0;         // Nodes visited finding place of a key
+    uint64_t rotations = 0;             // Double rotation counts as two
+    uint64_t color_flips = 0;           // Node and both children recoloured
+    uint64_t allocations = 0;           // Nodes created
+    uint64_t deallocations = 0;         // Nodes freed
+    size_t size = 0;
+    // No root to leaf path is longer. Exact height for avl, 2 * black_height
+    // for red black, max_depth for an unbalanced tree as erase never moves a
+    // node down. Use depth() for the exact height, it walks every node.
+    size_t height_bound = 0;
+    size_t black_height = 0;            // Black nodes on any root to leaf path, 0 unless red black
+    size_t max_depth = 0;               // Deepest node reached by insert or lookup since clear, not lowered by erase
+};
+
+// Live counters behind bst_stats. Relaxed atomics, so that const lookups
+// from many threads and parallel set operations can count without a race.
+class bst_counters {
+public:
+    enum index_type : size_t {
+        lookups,
+        lookup_visits,
+        lookup_hits,
+        insert_visits,
+        rotations,
+        color_flips,
+        allocations,
+        deallocations,
+        max_depth,
+        index_count
+    };
+
+private:
+    std::atomic<uint64_t> values[index_count] { };
+
+public:
+    bst_counters() { }
+
+    // Moved trees take their counters along
+    bst_counters(const bst_counters &other) {
+        *this = other;
+    }
+
+    bst_counters &operator=(const bst_counters &other) {
+        for(size_t index = 0; index < index_count; ++index) {
+            values[index].store(other.values[index].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    void add(index_type index, uint64_t amount = 1) {
+        values[index].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    // Keeps largest value seen
+    void raise(index_type index, uint64_t value) {
+        auto current = values[index].load(std::memory_order_relaxed);
+        while(current < value && !values[index].compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+    }
+
+    void set(index_type index, uint64_t value) {
+        values[index].store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t get(index_type index) const {
+        return values[index].load(std::memory_order_relaxed);
+    }
+}; // class bst_counters
+
+// Counters of a tree without with_stats
+struct bst_no_counters { };
+
+} // namespace rohit
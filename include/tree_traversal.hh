@@ -12,104 +12,308 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
+
+#pragma once
+
 #include <tree.hh>
+#include <generator.hh>
+#include <thread_pool.hh>
+#include <bit>
+#include <concepts>
+#include <functional>
+#include <iterator>
+#include <type_traits>
 #include <vector>
-#include <stack>
 #include <ranges>
 
 namespace rohit {
 
-template <typename key_type, typename value_type, blancing_type impl>
-std::vector<std::pair<key_type, value_type>> inorder(bst_node<key_type, value_type, impl> *root) {
-    std::vector<std::pair<key_type, value_type>> results;
-    std::stack<bst_node<key_type, value_type, impl> *> st;
-    
-    while(root) {
-        st.push(root);
-        root = root->left;
+enum class traversal_order {
+    inorder,
+    preorder,
+    postorder
+};
+
+// First node of subtree of root in order, nullptr for empty subtree
+template <traversal_order order, typename node_type>
+node_type * traversal_first(node_type *root) {
+    if (root == nullptr || order == traversal_order::preorder) return root;
+    while(true) {
+        if (root->left) root = root->left;
+        else if (order == traversal_order::postorder && root->right) root = root->right;
+        else return root;
     }
+}
 
-    while(!st.empty()) {
-        auto top = st.top();
-        results.push_back(std::make_pair(top->key, top->value));
-        st.pop();
-        auto root = top->right;
-        while(root) {
-            st.push(root);
-            root = root->left;
+// Node after node in order, nullptr once subtree of root is done. Walks
+// parent links, so nothing is kept between steps.
+template <traversal_order order, typename node_type>
+node_type * traversal_next(node_type *node, node_type *root) {
+    if constexpr (order == traversal_order::inorder) {
+        if (node->right) return traversal_first<order>(node->right);
+        while(node != root && node->parent->right == node) node = node->parent;
+        return node == root ? nullptr : node->parent;
+    } else if constexpr (order == traversal_order::preorder) {
+        if (node->left) return node->left;
+        if (node->right) return node->right;
+        for(; node != root; node = node->parent) {
+            auto parent = node->parent;
+            if (parent->left == node && parent->right) return parent->right;
         }
+        return nullptr;
+    } else {
+        if (node == root) return nullptr;
+        auto parent = node->parent;
+        if (parent->left == node && parent->right) return traversal_first<order>(parent->right);
+        return parent;
     }
-    return results;    
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-std::vector<std::pair<key_type, value_type>> inorder(bst<key_type, value_type, impl> &bst) {
-    return inorder(bst.root);
+// Calls visitor(node) for every node of subtree of root. Visitor returning
+// bool stops the walk with false, which is then returned.
+template <traversal_order order, typename node_type, typename visitor_type>
+bool visit(node_type *root, visitor_type &&visitor) {
+    for(auto node = traversal_first<order>(root); node != nullptr; node = traversal_next<order>(node, root)) {
+        if constexpr (std::same_as<std::invoke_result_t<visitor_type &, node_type &>, bool>) {
+            if (!visitor(*node)) return false;
+        } else {
+            visitor(*node);
+        }
+    }
+    return true;
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-std::vector<std::pair<key_type, value_type>> postorder(bst_node<key_type, value_type, impl> *root) {
-    std::vector<std::pair<key_type, value_type>> results;
-    std::stack<bst_node<key_type, value_type, impl> *> st;
-    
-    while(root) {
-        st.push(root);
-        root = root->left;
+template <traversal_order order, typename node_type>
+generator<node_type &> traversal_nodes(node_type *root) {
+    for(auto node = traversal_first<order>(root); node != nullptr; node = traversal_next<order>(node, root)) {
+        co_yield *node;
     }
+}
 
-    while(!st.empty()) {
-        auto top = st.top();
-        if (top->right == nullptr) {
-            st.pop();
-            results.push_back(std::make_pair(top->key, top->value));
-            while(!st.empty() && st.top()->right == top) {
-                top = st.top();
-                st.pop();
-                results.push_back(std::make_pair(top->key, top->value));
-            }
-        } else {
-            auto root = top->right;
-            while(root) {
-                st.push(root);
-                root = root->left;
-            }
-        }
+// Copy of every (key, value) pair, reserved up front when size is known
+template <traversal_order order, typename key_type, typename value_type, blancing_type impl, typename augment_type>
+std::vector<std::pair<key_type, value_type>> traversal_pairs(bst_node<key_type, value_type, impl, augment_type> *root, size_t size) {
+    std::vector<std::pair<key_type, value_type>> results;
+    results.reserve(size);
+    visit<order>(root, [&](auto &node) { results.emplace_back(node.key, node.value); });
+    return results;
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type>
+size_t traversal_size(bst_node<key_type, value_type, impl, augment_type> *root) {
+    if constexpr (order_statistic_augment<augment_type>) return root ? root->size : 0;
+    else return 0;
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type>
+std::vector<std::pair<key_type, value_type>> inorder(bst_node<key_type, value_type, impl, augment_type> *root) {
+    return traversal_pairs<traversal_order::inorder>(root, traversal_size(root));
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+std::vector<std::pair<key_type, value_type>> inorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    return traversal_pairs<traversal_order::inorder>(bst.root, bst.size());
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type>
+std::vector<std::pair<key_type, value_type>> postorder(bst_node<key_type, value_type, impl, augment_type> *root) {
+    return traversal_pairs<traversal_order::postorder>(root, traversal_size(root));
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+std::vector<std::pair<key_type, value_type>> postorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    return traversal_pairs<traversal_order::postorder>(bst.root, bst.size());
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type>
+std::vector<std::pair<key_type, value_type>> preorder(bst_node<key_type, value_type, impl, augment_type> *root) {
+    return traversal_pairs<traversal_order::preorder>(root, traversal_size(root));
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+std::vector<std::pair<key_type, value_type>> preorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    return traversal_pairs<traversal_order::preorder>(bst.root, bst.size());
+}
+
+// Visitor versions, visitor gets node reference and may stop by returning
+// false. No allocation and no stack.
+template <typename visitor_type, typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+bool visit_inorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst, visitor_type &&visitor) {
+    return visit<traversal_order::inorder>(bst.root, visitor);
+}
+
+template <typename visitor_type, typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+bool visit_preorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst, visitor_type &&visitor) {
+    return visit<traversal_order::preorder>(bst.root, visitor);
+}
+
+template <typename visitor_type, typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+bool visit_postorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst, visitor_type &&visitor) {
+    return visit<traversal_order::postorder>(bst.root, visitor);
+}
+
+// Generator versions, lazy range of node references. Tree must not be
+// modified while range is in use.
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+generator<bst_node<key_type, value_type, impl, augment_type> &> inorder_nodes(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    return traversal_nodes<traversal_order::inorder>(bst.root);
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+generator<bst_node<key_type, value_type, impl, augment_type> &> preorder_nodes(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    return traversal_nodes<traversal_order::preorder>(bst.root);
+}
+
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+generator<bst_node<key_type, value_type, impl, augment_type> &> postorder_nodes(bst<key_type, value_type, impl, augment_type, allocator_type> &bst) {
+    return traversal_nodes<traversal_order::postorder>(bst.root);
+}
+
+// Output iterator versions, writes projection(node) for every node and
+// returns output past last write. Default projection writes node reference,
+// e.g. &node_type::key streams keys only.
+template <std::weakly_incrementable output_type, typename projection_type = std::identity,
+    typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+output_type inorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst, output_type output, projection_type projection = { }) {
+    visit<traversal_order::inorder>(bst.root, [&](auto &node) { *output = std::invoke(projection, node); ++output; });
+    return output;
+}
+
+template <std::weakly_incrementable output_type, typename projection_type = std::identity,
+    typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+output_type preorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst, output_type output, projection_type projection = { }) {
+    visit<traversal_order::preorder>(bst.root, [&](auto &node) { *output = std::invoke(projection, node); ++output; });
+    return output;
+}
+
+template <std::weakly_incrementable output_type, typename projection_type = std::identity,
+    typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+output_type postorder(bst<key_type, value_type, impl, augment_type, allocator_type> &bst, output_type output, projection_type projection = { }) {
+    visit<traversal_order::postorder>(bst.root, [&](auto &node) { *output = std::invoke(projection, node); ++output; });
+    return output;
+}
+
+// Part of an inorder split, either a single node or its whole subtree
+template <typename node_type>
+struct traversal_piece {
+    node_type *node;
+    bool subtree;
+};
+
+// Pieces of tree in inorder, every node is in exactly one piece. Nodes above
+// split depth are single pieces, so recursion and piece count are bounded by
+// depth even on a degenerate chain, where most nodes stay in one piece. With
+// order_statistic subtrees no larger than grain are not split further.
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type>
+void split_inorder(bst_node<key_type, value_type, impl, augment_type> *node, size_t depth, size_t grain,
+    std::vector<traversal_piece<bst_node<key_type, value_type, impl, augment_type>>> &pieces) {
+    if (node == nullptr) return;
+    bool split = depth > 0;
+    if constexpr (order_statistic_augment<augment_type>) split = split && node->size > grain;
+    if (!split) {
+        pieces.push_back({ node, true });
+        return;
     }
-    return results;    
+    split_inorder(node->left, depth - 1, grain, pieces);
+    pieces.push_back({ node, false });
+    split_inorder(node->right, depth - 1, grain, pieces);
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-std::vector<std::pair<key_type, value_type>> postorder(bst<key_type, value_type, impl> &bst) {
-    return postorder(bst.root);
+// Subtree of root in inorder over parent links, no stack
+template <typename node_type, typename function_type>
+void subtree_inorder(node_type *root, function_type &&function) {
+    visit<traversal_order::inorder>(root, function);
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-std::vector<std::pair<key_type, value_type>> preorder(bst_node<key_type, value_type, impl> *root) {
-    std::vector<std::pair<key_type, value_type>> results;
-    std::stack<bst_node<key_type, value_type, impl> *> st;
-    
-    while(root) {
-        results.push_back(std::make_pair(root->key, root->value));
-        st.push(root);
-        root = root->left;
+template <typename node_type, typename function_type>
+void piece_inorder(const traversal_piece<node_type> &piece, function_type &&function) {
+    if (piece.subtree) subtree_inorder(piece.node, function);
+    else function(*piece.node);
+}
+
+// Several pieces per thread, stealing evens out pieces of different size
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+std::vector<traversal_piece<bst_node<key_type, value_type, impl, augment_type>>> split_inorder(
+    bst<key_type, value_type, impl, augment_type, allocator_type> &tree, thread_pool &pool) {
+    constexpr size_t pieces_per_thread = 8;
+    auto target = pieces_per_thread * (pool.size() + 1);
+    std::vector<traversal_piece<bst_node<key_type, value_type, impl, augment_type>>> pieces;
+    split_inorder(tree.root, std::bit_width(target), std::max<size_t>(1, tree.size() / target), pieces);
+    return pieces;
+}
+
+// Calls function(node) for every node, concurrently and in no fixed order.
+// Tree must not be modified meanwhile, function may modify node->value.
+template <typename function_type, typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+void parallel_for_each(bst<key_type, value_type, impl, augment_type, allocator_type> &tree, function_type &&function,
+    thread_pool &pool = thread_pool::global()) {
+    auto pieces = split_inorder(tree, pool);
+    pool.run(pieces.size(), [&](size_t index) {
+        piece_inorder(pieces[index], function);
+    });
+}
+
+// Folds transform(node) of every node with reduce. Every piece starts from
+// init, so init must be identity of reduce. Pieces are combined in inorder,
+// so reduce needs to be associative but not commutative.
+template <typename result_type, typename reduce_type, typename transform_type,
+    typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+result_type parallel_reduce(bst<key_type, value_type, impl, augment_type, allocator_type> &tree, result_type init,
+    reduce_type reduce, transform_type transform, thread_pool &pool = thread_pool::global()) {
+    auto pieces = split_inorder(tree, pool);
+    std::vector<result_type> partial(pieces.size(), init);
+    pool.run(pieces.size(), [&](size_t index) {
+        auto &result = partial[index];
+        piece_inorder(pieces[index], [&](auto &node) { result = reduce(std::move(result), transform(node)); });
+    });
+    for(auto &result: partial) {
+        init = reduce(std::move(init), std::move(result));
     }
+    return init;
+}
 
-    while(!st.empty()) {
-        auto top = st.top();
-        st.pop();
-        auto root = top->right;
-        while(root) {
-            results.push_back(std::make_pair(root->key, root->value));
-            st.push(root);
-            root = root->left;
-        }
+// Writes (key, value) of every node in inorder to output[0, tree.size()).
+// Output is assigned by index, it must already hold tree.size() elements.
+// Offset of each piece comes from subtree size, counted in a first parallel
+// pass unless order_statistic keeps it.
+template <std::random_access_iterator output_type, typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+void parallel_inorder(bst<key_type, value_type, impl, augment_type, allocator_type> &tree, output_type output,
+    thread_pool &pool = thread_pool::global()) {
+    auto pieces = split_inorder(tree, pool);
+    std::vector<size_t> offsets(pieces.size() + 1);
+    auto piece_size = [&](size_t index) {
+        auto &piece = pieces[index];
+        size_t result = 0;
+        if (!piece.subtree) result = 1;
+        else if constexpr (order_statistic_augment<augment_type>) result = piece.node->size;
+        else subtree_inorder(piece.node, [&](auto &) { ++result; });
+        offsets[index + 1] = result;
+    };
+    if constexpr (order_statistic_augment<augment_type>) {
+        for(size_t index = 0; index < pieces.size(); ++index) piece_size(index);
+    } else {
+        pool.run(pieces.size(), piece_size);
+    }
+    for(size_t index = 1; index < offsets.size(); ++index) {
+        offsets[index] += offsets[index - 1];
     }
-    return results;    
+    assert(offsets.back() == tree.size());
+
+    pool.run(pieces.size(), [&](size_t index) {
+        auto position = output + offsets[index];
+        piece_inorder(pieces[index], [&](auto &node) {
+            *position = std::make_pair(node.key, node.value);
+            ++position;
+        });
+    });
 }
 
-template <typename key_type, typename value_type, blancing_type impl>
-std::vector<std::pair<key_type, value_type>> preorder(bst<key_type, value_type, impl> &bst) {
-    return preorder(bst.root);
+template <typename key_type, typename value_type, blancing_type impl, typename augment_type, typename allocator_type>
+std::vector<std::pair<key_type, value_type>> parallel_inorder(bst<key_type, value_type, impl, augment_type, allocator_type> &tree,
+    thread_pool &pool = thread_pool::global()) {
+    std::vector<std::pair<key_type, value_type>> results(tree.size());
+    parallel_inorder(tree, results.begin(), pool);
+    return results;
 }
 
 } // namespace rohit
\ No newline at end of file
@@ -16,13 +16,31 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <tree.hh>
+#include <btree.hh>
+#include <simd_search.hh>
+#include <algorithm>
+#include <assert.h>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <queue>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace rohit {
 
+// Value which marks a missing key, value initialised unless specialised
 template <typename value_type>
-struct default_value;
+struct default_value {
+    static inline const value_type value { };
+};
 
 template<>
 struct default_value<bool> {
@@ -49,13 +67,34 @@ struct default_value<double> {
     static constexpr double value = 0.0;
 };
 
+// Values which can rank completions, see tries::top_k_completions. Kept to
+// arithmetic types, subtree maximum is copied into every node on insert path.
+template <typename value_type>
+concept tries_ranked_value = std::is_arithmetic_v<value_type> && !std::same_as<value_type, bool>;
+
+template <typename value_type>
+struct tries_node_rank { };
+
+template <tries_ranked_value value_type>
+struct tries_node_rank<value_type> {
+    // Largest value stored in subtree. Insert only ever raises it, so after a
+    // value is overwritten by a smaller one it is still an upper bound.
+    value_type best = default_value<value_type>::value;
+};
+
 template <typename value_type, typename TLIST>
-struct tries_node {
+struct tries_node : tries_node_rank<value_type> {
     typedef tries_node* iterator;
     value_type value = default_value<value_type>::value;
 
     TLIST children;
 
+    tries_node() { }
+
+    // Value built in place, children start empty
+    template <typename... args_type>
+    explicit tries_node(std::in_place_t, args_type&&... args) : value(std::forward<args_type>(args)...) { }
+
     auto end() { return children.end(); }
 }; // class tries_node
 
@@ -67,6 +106,16 @@ struct tries_unordered_map {
 
     std::unordered_map<key_char_type, node_type *> list;
 
+    tries_unordered_map() { }
+    tries_unordered_map(const tries_unordered_map &) = delete;
+    tries_unordered_map &operator=(const tries_unordered_map &) = delete;
+
+    ~tries_unordered_map() {
+        for(auto &child: list) {
+            delete child.second;
+        }
+    }
+
     auto find(const key_char_type &key_char) {
         auto result = list.find(key_char);
         if (result == list.end()) {
@@ -76,8 +125,10 @@ struct tries_unordered_map {
         return result->second;
     }
 
-    auto insert(const key_char_type& key_char) {
-        auto child = new node_type();
+    // New child with value built in place from args
+    template <typename... args_type>
+    auto insert(const key_char_type& key_char, args_type&&... args) {
+        auto child = new node_type(std::in_place, std::forward<args_type>(args)...);
         list.insert(make_pair(key_char, child));
         return child;
     }
@@ -85,6 +136,28 @@ struct tries_unordered_map {
     iterator end() {
         return nullptr;
     }
+
+    // Visits (key_char, child) of every child, in no particular order
+    template <typename function_type>
+    void for_each_child(function_type &&function) {
+        for(auto &child: list) {
+            function(child.first, child.second);
+        }
+    }
+
+    // Position in for_each_child order, lets a walk resume without a callback
+    using cursor = std::unordered_map<key_char_type, node_type *>::iterator;
+
+    cursor first_child() { return list.begin(); }
+
+    // Child at position, which then moves on. False past last child.
+    bool next_child(cursor &position, key_char_type &key_char, node_type *&child) {
+        if (position == list.end()) return false;
+        key_char = position->first;
+        child = position->second;
+        ++position;
+        return true;
+    }
 };
 
 template <typename key_type, typename value_type = bool, blancing_type impl = blancing_type::none>
@@ -93,7 +166,19 @@ struct tries_tree {
     using node_type = tries_node<value_type, tries_tree>;
     using iterator = node_type::iterator;
 
-    rohit::bst<key_char_type, node_type *, impl> list;
+    // Most nodes have one or two children, a slab pool per node would cost
+    // more than its nodes
+    rohit::bst<key_char_type, node_type *, impl, no_augment, std::allocator<node_type *>> list;
+
+    tries_tree() { }
+    tries_tree(const tries_tree &) = delete;
+    tries_tree &operator=(const tries_tree &) = delete;
+
+    ~tries_tree() {
+        for(auto &child: list) {
+            delete child.value;
+        }
+    }
 
     iterator find(const key_char_type &key_char) {
         auto result = list.find(key_char);
@@ -104,8 +189,10 @@ struct tries_tree {
         return result->value;
     }
 
-    auto insert(const key_char_type& key_char) {
-        auto child = new node_type();
+    // New child with value built in place from args
+    template <typename... args_type>
+    auto insert(const key_char_type& key_char, args_type&&... args) {
+        auto child = new node_type(std::in_place, std::forward<args_type>(args)...);
         list.insert(key_char, child);
         return child;
     }
@@ -113,48 +200,920 @@ struct tries_tree {
     iterator end() {
         return nullptr;
     }
+
+    // Visits (key_char, child) of every child in key_char order
+    template <typename function_type>
+    void for_each_child(function_type &&function) {
+        for(auto &child: list) {
+            function(child.key, child.value);
+        }
+    }
+
+    // Position in for_each_child order, lets a walk resume without a callback
+    using cursor = decltype(list)::iterator;
+
+    cursor first_child() { return list.begin(); }
+
+    // Child at position, which then moves on. False past last child.
+    bool next_child(cursor &position, key_char_type &key_char, node_type *&child) {
+        if (position == list.end()) return false;
+        key_char = position->key;
+        child = position->value;
+        ++position;
+        return true;
+    }
+};
+
+template <typename key_type, typename value_type = bool, size_t node_bytes = 64>
+struct tries_btree {
+    using key_char_type = key_type::value_type;
+    using node_type = tries_node<value_type, tries_btree>;
+    using iterator = node_type::iterator;
+
+    rohit::btree<key_char_type, node_type *, node_bytes> list;
+
+    tries_btree() { }
+    tries_btree(const tries_btree &) = delete;
+    tries_btree &operator=(const tries_btree &) = delete;
+
+    ~tries_btree() {
+        for(auto child: list) {
+            delete child.value;
+        }
+    }
+
+    iterator find(const key_char_type &key_char) {
+        auto result = list.find(key_char);
+        if (result == list.end()) {
+            return end();
+        }
+
+        return result->value;
+    }
+
+    // New child with value built in place from args
+    template <typename... args_type>
+    auto insert(const key_char_type& key_char, args_type&&... args) {
+        auto child = new node_type(std::in_place, std::forward<args_type>(args)...);
+        list.insert(key_char, child);
+        return child;
+    }
+
+    iterator end() {
+        return nullptr;
+    }
+
+    // Visits (key_char, child) of every child in key_char order
+    template <typename function_type>
+    void for_each_child(function_type &&function) {
+        for(auto child: list) {
+            function(child.key, child.value);
+        }
+    }
+
+    // Position in for_each_child order, lets a walk resume without a callback
+    using cursor = decltype(list)::iterator;
+
+    cursor first_child() { return list.begin(); }
+
+    // Child at position, which then moves on. False past last child.
+    bool next_child(cursor &position, key_char_type &key_char, node_type *&child) {
+        if (position == list.end()) return false;
+        key_char = position->key;
+        child = position->value;
+        ++position;
+        return true;
+    }
+};
+
+// Adaptive radix tree children. Child block grows node4 -> node16 -> node48
+// -> node256 with fan-out, so a node only pays for children it has. A chain
+// of single child nodes is collapsed into prefix of the node at its end, tries
+// switches to path compressed walk for this TLIST (see path_compressed).
+template <typename key_type, typename value_type = bool>
+struct tries_art {
+    using key_char_type = key_type::value_type;
+    using node_type = tries_node<value_type, tries_art>;
+    using iterator = node_type::iterator;
+    static_assert(sizeof(key_char_type) == 1, "tries_art: children are indexed by byte");
+
+    static constexpr bool path_compressed = true;
+
+    enum class kind_type : uint8_t {
+        empty,
+        node4,
+        node16,
+        node48,
+        node256
+    };
+
+    // node4 and node16 keep keys sorted
+    struct node4 {
+        uint8_t keys[4];
+        node_type *children[4];
+    };
+
+    struct node16 {
+        uint8_t keys[16];
+        node_type *children[16];
+    };
+
+    // index[byte] is slot + 1, 0 when absent
+    struct node48 {
+        uint8_t index[256];
+        node_type *children[48];
+    };
+
+    struct node256 {
+        node_type *children[256];
+    };
+
+    // Characters consumed after the edge into this node, before its value
+    std::basic_string<key_char_type> prefix;
+    kind_type kind = kind_type::empty;
+    uint16_t count = 0;
+    void *block = nullptr;
+
+    tries_art() { }
+    tries_art(const tries_art &) = delete;
+    tries_art &operator=(const tries_art &) = delete;
+
+    ~tries_art() {
+        for_each_child([](auto, node_type *child) {
+            delete child;
+        });
+        free_block();
+    }
+
+    static uint8_t byte(key_char_type key_char) {
+        return static_cast<uint8_t>(key_char);
+    }
+
+    size_t capacity() const {
+        switch(kind) {
+        case kind_type::node4: return 4;
+        case kind_type::node16: return 16;
+        case kind_type::node48: return 48;
+        case kind_type::node256: return 256;
+        default: return 0;
+        }
+    }
+
+    void free_block() {
+        switch(kind) {
+        case kind_type::node4: delete static_cast<node4 *>(block); break;
+        case kind_type::node16: delete static_cast<node16 *>(block); break;
+        case kind_type::node48: delete static_cast<node48 *>(block); break;
+        case kind_type::node256: delete static_cast<node256 *>(block); break;
+        default: break;
+        }
+        block = nullptr;
+    }
+
+    // Moves children to next larger block
+    void grow() {
+        void *next = nullptr;
+        kind_type next_kind = kind_type::node4;
+        switch(kind) {
+        case kind_type::empty:
+            next = new node4 { };
+            break;
+        case kind_type::node4: {
+            auto curr = static_cast<node4 *>(block);
+            auto larger = new node16 { };
+            std::copy(curr->keys, curr->keys + count, larger->keys);
+            std::copy(curr->children, curr->children + count, larger->children);
+            next = larger;
+            next_kind = kind_type::node16;
+            break;
+        }
+        case kind_type::node16: {
+            auto curr = static_cast<node16 *>(block);
+            auto larger = new node48 { };
+            for(size_t index = 0; index < count; ++index) {
+                larger->index[curr->keys[index]] = static_cast<uint8_t>(index + 1);
+                larger->children[index] = curr->children[index];
+            }
+            next = larger;
+            next_kind = kind_type::node48;
+            break;
+        }
+        default: {
+            assert(kind == kind_type::node48);
+            auto curr = static_cast<node48 *>(block);
+            auto larger = new node256 { };
+            for(size_t key_byte = 0; key_byte < 256; ++key_byte) {
+                if (curr->index[key_byte]) larger->children[key_byte] = curr->children[curr->index[key_byte] - 1];
+            }
+            next = larger;
+            next_kind = kind_type::node256;
+            break;
+        }
+        }
+        free_block();
+        block = next;
+        kind = next_kind;
+    }
+
+    static void insert_sorted(uint8_t *keys, node_type **children, size_t size, uint8_t key_byte, node_type *child) {
+        size_t position = std::lower_bound(keys, keys + size, key_byte) - keys;
+        std::copy_backward(keys + position, keys + size, keys + size + 1);
+        std::copy_backward(children + position, children + size, children + size + 1);
+        keys[position] = key_byte;
+        children[position] = child;
+    }
+
+    iterator find(const key_char_type &key_char) {
+        auto key_byte = byte(key_char);
+        switch(kind) {
+        case kind_type::node4: {
+            auto curr = static_cast<node4 *>(block);
+            for(size_t index = 0; index < count; ++index) {
+                if (curr->keys[index] == key_byte) return curr->children[index];
+            }
+            return end();
+        }
+        case kind_type::node16: {
+            auto curr = static_cast<node16 *>(block);
+            auto index = simd::find_byte(curr->keys, count, key_byte);
+            return index < count ? curr->children[index] : end();
+        }
+        case kind_type::node48: {
+            auto curr = static_cast<node48 *>(block);
+            auto slot = curr->index[key_byte];
+            return slot ? curr->children[slot - 1] : end();
+        }
+        case kind_type::node256:
+            return static_cast<node256 *>(block)->children[key_byte];
+        default:
+            return end();
+        }
+    }
+
+    // key_char must not be present
+    void attach(const key_char_type &key_char, node_type *child) {
+        if (count == capacity()) grow();
+        auto key_byte = byte(key_char);
+        switch(kind) {
+        case kind_type::node4: {
+            auto curr = static_cast<node4 *>(block);
+            insert_sorted(curr->keys, curr->children, count, key_byte, child);
+            break;
+        }
+        case kind_type::node16: {
+            auto curr = static_cast<node16 *>(block);
+            insert_sorted(curr->keys, curr->children, count, key_byte, child);
+            break;
+        }
+        case kind_type::node48: {
+            // Children are never removed, so slots below count are all used
+            auto curr = static_cast<node48 *>(block);
+            curr->index[key_byte] = static_cast<uint8_t>(count + 1);
+            curr->children[count] = child;
+            break;
+        }
+        default:
+            static_cast<node256 *>(block)->children[key_byte] = child;
+            break;
+        }
+        ++count;
+    }
+
+    // New child with value built in place from args
+    template <typename... args_type>
+    auto insert(const key_char_type& key_char, args_type&&... args) {
+        auto child = new node_type(std::in_place, std::forward<args_type>(args)...);
+        attach(key_char, child);
+        return child;
+    }
+
+    iterator end() {
+        return nullptr;
+    }
+
+    // Used by node split, exchanges prefix and all children
+    void swap(tries_art &other) {
+        std::swap(prefix, other.prefix);
+        std::swap(kind, other.kind);
+        std::swap(count, other.count);
+        std::swap(block, other.block);
+    }
+
+    // Visits (key_char, child) of every child in key_char order
+    template <typename function_type>
+    void for_each_child(function_type &&function) {
+        switch(kind) {
+        case kind_type::node4: {
+            auto curr = static_cast<node4 *>(block);
+            for(size_t index = 0; index < count; ++index) {
+                function(static_cast<key_char_type>(curr->keys[index]), curr->children[index]);
+            }
+            break;
+        }
+        case kind_type::node16: {
+            auto curr = static_cast<node16 *>(block);
+            for(size_t index = 0; index < count; ++index) {
+                function(static_cast<key_char_type>(curr->keys[index]), curr->children[index]);
+            }
+            break;
+        }
+        case kind_type::node48: {
+            auto curr = static_cast<node48 *>(block);
+            for(size_t key_byte = 0; key_byte < 256; ++key_byte) {
+                if (curr->index[key_byte]) function(static_cast<key_char_type>(key_byte), curr->children[curr->index[key_byte] - 1]);
+            }
+            break;
+        }
+        case kind_type::node256: {
+            auto curr = static_cast<node256 *>(block);
+            for(size_t key_byte = 0; key_byte < 256; ++key_byte) {
+                if (curr->children[key_byte]) function(static_cast<key_char_type>(key_byte), curr->children[key_byte]);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // Position in for_each_child order, slot of node4 and node16 or byte of
+    // node48 and node256
+    using cursor = size_t;
+
+    cursor first_child() { return 0; }
+
+    // Child at position, which then moves on. False past last child.
+    bool next_child(cursor &position, key_char_type &key_char, node_type *&child) {
+        switch(kind) {
+        case kind_type::node4:
+        case kind_type::node16: {
+            if (position >= count) return false;
+            auto keys = kind == kind_type::node4 ? static_cast<node4 *>(block)->keys : static_cast<node16 *>(block)->keys;
+            auto children = kind == kind_type::node4 ? static_cast<node4 *>(block)->children : static_cast<node16 *>(block)->children;
+            key_char = static_cast<key_char_type>(keys[position]);
+            child = children[position++];
+            return true;
+        }
+        case kind_type::node48: {
+            auto curr = static_cast<node48 *>(block);
+            for(; position < 256; ++position) {
+                if (curr->index[position]) {
+                    key_char = static_cast<key_char_type>(position);
+                    child = curr->children[curr->index[position++] - 1];
+                    return true;
+                }
+            }
+            return false;
+        }
+        case kind_type::node256: {
+            auto curr = static_cast<node256 *>(block);
+            for(; position < 256; ++position) {
+                if (curr->children[position]) {
+                    key_char = static_cast<key_char_type>(position);
+                    child = curr->children[position++];
+                    return true;
+                }
+            }
+            return false;
+        }
+        default:
+            return false;
+        }
+    }
+};
+
+// Children kept inside the node while fan-out is small. Up to inline_count
+// children live in sorted arrays in the node itself, no allocation and no
+// pointer to follow before the child. Larger fan-out moves to one heap block
+// of sorted keys followed by children, grown 16 at a time and searched 16
+// keys per compare, then to a dense table indexed by byte above
+// sorted_limit. Mode is decided by count alone, children are never removed.
+template <typename key_type, typename value_type = bool, size_t inline_count = 4>
+    requires (inline_count >= 1 && inline_count <= 8)
+struct tries_flat {
+    using key_char_type = key_type::value_type;
+    using node_type = tries_node<value_type, tries_flat>;
+    using iterator = node_type::iterator;
+    static_assert(sizeof(key_char_type) == 1, "tries_flat: children are indexed by byte");
+
+    // Sorted block capacity is a multiple of block_step, so every 16 byte
+    // load in find stays inside the block
+    static constexpr size_t block_step = 16;
+    static constexpr size_t sorted_limit = 48;
+
+    uint16_t count = 0;
+    uint8_t keys[inline_count] { };       // Zeroed, find loads all of them as one word
+    union {
+        node_type *children[inline_count];
+        uint8_t *block;         // capacity keys, then capacity children
+        node_type **table;      // 256 children, nullptr when absent
+    };
+
+    tries_flat() { }
+    tries_flat(const tries_flat &) = delete;
+    tries_flat &operator=(const tries_flat &) = delete;
+
+    ~tries_flat() {
+        for_each_child([](auto, node_type *child) {
+            delete child;
+        });
+        if (is_dense()) delete[] table;
+        else if (!is_inline()) delete[] block;
+    }
+
+    static uint8_t byte(key_char_type key_char) {
+        return static_cast<uint8_t>(key_char);
+    }
+
+    bool is_inline() const { return count <= inline_count; }
+    bool is_dense() const { return count > sorted_limit; }
+
+    // Sorted mode only
+    static size_t block_capacity(size_t size) {
+        return (size + block_step - 1) / block_step * block_step;
+    }
+
+    uint8_t *block_keys() const { return block; }
+
+    node_type **block_children() const {
+        return reinterpret_cast<node_type **>(block + block_capacity(count));
+    }
+
+    // Zeroed, so padding keys past count read by find are initialised
+    static uint8_t *allocate_block(size_t capacity) {
+        return new uint8_t[capacity * (1 + sizeof(node_type *))] { };
+    }
+
+    static void insert_sorted(uint8_t *sorted_keys, node_type **sorted_children, size_t size, uint8_t key_byte, node_type *child) {
+        size_t position = std::lower_bound(sorted_keys, sorted_keys + size, key_byte) - sorted_keys;
+        std::copy_backward(sorted_keys + position, sorted_keys + size, sorted_keys + size + 1);
+        std::copy_backward(sorted_children + position, sorted_children + size, sorted_children + size + 1);
+        sorted_keys[position] = key_byte;
+        sorted_children[position] = child;
+    }
+
+    iterator find(const key_char_type &key_char) {
+        auto key_byte = byte(key_char);
+        if (is_inline()) {
+            uint64_t word = 0;
+            std::memcpy(&word, keys, inline_count);
+            auto index = simd::find_byte_word(word, count, key_byte);
+            return index < count ? children[index] : end();
+        }
+        if (is_dense()) return table[key_byte];
+        auto sorted_keys = block_keys();
+        for(size_t offset = 0; offset < count; offset += block_step) {
+            auto size = std::min<size_t>(block_step, count - offset);
+            auto index = simd::find_byte(sorted_keys + offset, size, key_byte);
+            if (index < size) return block_children()[offset + index];
+        }
+        return end();
+    }
+
+    // key_char must not be present. Storage for next mode is allocated
+    // before anything is moved, so a throw leaves node unchanged.
+    void attach(const key_char_type &key_char, node_type *child) {
+        auto key_byte = byte(key_char);
+        if (count < inline_count) {
+            insert_sorted(keys, children, count, key_byte, child);
+        } else if (count == sorted_limit) {
+            auto dense = new node_type *[256] { };
+            auto sorted_keys = block_keys();
+            auto sorted_children = block_children();
+            for(size_t index = 0; index < count; ++index) {
+                dense[sorted_keys[index]] = sorted_children[index];
+            }
+            dense[key_byte] = child;
+            delete[] block;
+            table = dense;
+        } else if (is_dense()) {
+            table[key_byte] = child;
+        } else if (count % block_step == 0 || count == inline_count) {
+            // Full, move to a block with block_step more slots
+            auto capacity = block_capacity(count + 1);
+            auto next = allocate_block(capacity);
+            auto next_children = reinterpret_cast<node_type **>(next + capacity);
+            if (count == inline_count) {
+                std::copy(keys, keys + count, next);
+                std::copy(children, children + count, next_children);
+            } else {
+                std::copy(block_keys(), block_keys() + count, next);
+                std::copy(block_children(), block_children() + count, next_children);
+                delete[] block;
+            }
+            insert_sorted(next, next_children, count, key_byte, child);
+            block = next;
+        } else {
+            // Children pointer depends on count, read it before count moves
+            insert_sorted(block_keys(), block_children(), count, key_byte, child);
+        }
+        ++count;
+    }
+
+    // New child with value built in place from args
+    template <typename... args_type>
+    auto insert(const key_char_type& key_char, args_type&&... args) {
+        auto child = new node_type(std::in_place, std::forward<args_type>(args)...);
+        try {
+            attach(key_char, child);
+        } catch(...) {
+            delete child;
+            throw;
+        }
+        return child;
+    }
+
+    iterator end() {
+        return nullptr;
+    }
+
+    // Visits (key_char, child) of every child in byte order
+    template <typename function_type>
+    void for_each_child(function_type &&function) {
+        if (is_inline()) {
+            for(size_t index = 0; index < count; ++index) {
+                function(static_cast<key_char_type>(keys[index]), children[index]);
+            }
+        } else if (is_dense()) {
+            for(size_t key_byte = 0; key_byte < 256; ++key_byte) {
+                if (table[key_byte]) function(static_cast<key_char_type>(key_byte), table[key_byte]);
+            }
+        } else {
+            auto sorted_keys = block_keys();
+            auto sorted_children = block_children();
+            for(size_t index = 0; index < count; ++index) {
+                function(static_cast<key_char_type>(sorted_keys[index]), sorted_children[index]);
+            }
+        }
+    }
+
+    // Position in for_each_child order, slot of sorted children or byte of
+    // dense table
+    using cursor = size_t;
+
+    cursor first_child() { return 0; }
+
+    // Child at position, which then moves on. False past last child.
+    bool next_child(cursor &position, key_char_type &key_char, node_type *&child) {
+        if (is_dense()) {
+            for(; position < 256; ++position) {
+                if (table[position]) {
+                    key_char = static_cast<key_char_type>(position);
+                    child = table[position++];
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (position >= count) return false;
+        if (is_inline()) {
+            key_char = static_cast<key_char_type>(keys[position]);
+            child = children[position++];
+        } else {
+            key_char = static_cast<key_char_type>(block_keys()[position]);
+            child = block_children()[position++];
+        }
+        return true;
+    }
 };
 
+// Key a tries can walk without building key_type, for example
+// std::string_view or std::vector<char> for std::string keys
+template <typename lookup_type, typename key_char_type>
+concept tries_key = requires(const lookup_type &key, size_t index) {
+    { key.size() } -> std::convertible_to<size_t>;
+    key.begin();
+    key.end();
+} && std::same_as<std::remove_cvref_t<decltype(std::declval<const lookup_type &>()[0])>, key_char_type>;
+
+// tries_key, or a null terminated const key_char_type * which is read through
+// std::basic_string_view
+template <typename lookup_type, typename key_char_type>
+concept tries_lookup = tries_key<lookup_type, key_char_type> || std::convertible_to<const lookup_type &, const key_char_type *>;
+
+// TLIST keeps a prefix per node, key may move several characters per node
+template <typename TLIST>
+inline constexpr bool tries_path_compressed = requires { requires TLIST::path_compressed; };
+
+// Walks stored keys below one node in preorder. Each level keeps a cursor of
+// its TLIST, so memory is bounded by depth rather than by fan-out or number
+// of results. Order follows TLIST child order. Inserting into the tries
+// invalidates iterator.
+template <typename key_type, typename node_type>
+class tries_prefix_iterator {
+    using key_char_type = key_type::value_type;
+    using mapped_type = decltype(node_type::value);
+    using list_type = decltype(node_type::children);
+    static constexpr bool path_compressed = tries_path_compressed<list_type>;
+
+    struct frame {
+        node_type *node;
+        list_type::cursor position;
+        size_t key_size;
+    };
+
+    std::vector<frame> stack;
+    key_type key;
+    node_type *node = nullptr;
+
+    void enter(node_type *child) {
+        stack.push_back({ child, child->children.first_child(), key.size() });
+        node = child;
+    }
+
+    // Moves to next node holding a value, node is nullptr at the end
+    void advance() {
+        while(!stack.empty()) {
+            auto &top = stack.back();
+            key_char_type key_char;
+            node_type *child;
+            if (!top.node->children.next_child(top.position, key_char, child)) {
+                stack.pop_back();
+                continue;
+            }
+            key.resize(top.key_size);
+            key.push_back(key_char);
+            if constexpr (path_compressed) key.append(child->children.prefix);
+            enter(child);
+            if (child->value != default_value<mapped_type>::value) return;
+        }
+        node = nullptr;
+    }
+
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::pair<const key_type &, mapped_type &>;
+    using difference_type = std::ptrdiff_t;
+    using reference = value_type;
+
+    tries_prefix_iterator() { }
+
+    // key is full key of start, including its compressed prefix
+    tries_prefix_iterator(node_type *start, key_type key) : key(std::move(key)) {
+        if (start == nullptr) return;
+        enter(start);
+        if (start->value == default_value<mapped_type>::value) advance();
+    }
+
+    // Key reference is valid until iterator moves
+    reference operator*() const { return { key, node->value }; }
+
+    tries_prefix_iterator &operator++() {
+        advance();
+        return *this;
+    }
+
+    void operator++(int) {
+        advance();
+    }
+
+    bool operator==(const tries_prefix_iterator &other) const { return node == other.node; }
+}; // class tries_prefix_iterator
+
+// Lazy range returned by tries::with_prefix, nothing is walked before begin()
+template <typename key_type, typename node_type>
+class tries_prefix_range {
+    node_type *start;
+    key_type key;
+
+public:
+    using iterator = tries_prefix_iterator<key_type, node_type>;
+
+    tries_prefix_range(node_type *start, key_type key) : start(start), key(std::move(key)) { }
+
+    iterator begin() const { return iterator(start, key); }
+    iterator end() const { return iterator(); }
+}; // class tries_prefix_range
+
 template <typename key_type, typename value_type, typename TLIST>
 class tries {
     using node_type = tries_node<value_type, TLIST>;
     using iterator = tries_node<value_type, TLIST>::iterator;
+    using key_char_type = key_type::value_type;
+    using key_view_type = std::basic_string_view<key_char_type>;
 
     node_type root;
 
-public:
-    tries() {}
+    static constexpr bool path_compressed = tries_path_compressed<TLIST>;
+    static constexpr bool ranked = tries_ranked_value<value_type>;
+
+    static void raise_best(node_type *node, const value_type *rank) {
+        if constexpr (ranked) {
+            if (rank) node->best = std::max(node->best, *rank);
+        }
+    }
 
-    void insert(const key_type& key, value_type&& value) {
+    template <typename function_type>
+    static void for_each(node_type *node, key_type &key, function_type &function) {
+        auto key_size = key.size();
+        if constexpr (path_compressed) key.append(node->children.prefix);
+        if (node->value != default_value<value_type>::value) function(static_cast<const key_type &>(key), node->value);
+        node->children.for_each_child([&key, &function](auto key_char, node_type *child) {
+            key.push_back(key_char);
+            for_each(child, key, function);
+            key.pop_back();
+        });
+        key.resize(key_size);
+    }
+
+    // Key argument as walked: tries_key itself or a view of a null terminated
+    // const key_char_type *
+    template <typename lookup_type>
+    static decltype(auto) key_view(const lookup_type &key) {
+        if constexpr (tries_key<lookup_type, key_char_type>) return (key);
+        else return key_view_type(key);
+    }
+
+    // Finds node of key creating missing nodes, only a created end node gets
+    // its value built from args. Second is true when end node was created.
+    // rank, when set, raises subtree maxima on the way down.
+    template <typename lookup_type, typename... args_type>
+    std::pair<iterator, bool> emplace_node(const lookup_type& key, const value_type *rank, args_type&&... args) {
+        if constexpr (path_compressed) return emplace_compressed(key, rank, std::forward<args_type>(args)...);
         iterator itr = &root;
         auto key_itr = key.begin();
         for(;key_itr != key.end(); ++key_itr) {
-            iterator child_itr = itr->children.find(*key_itr);
-            if (child_itr == itr->children.end()) {
-                itr = itr->children.insert(*key_itr++);
-                for(;key_itr != key.end(); ++key_itr) {
-                    itr = itr->children.insert(*key_itr);
+            raise_best(itr, rank);
+            auto child = itr->children.find(*key_itr);
+            if (child == itr->children.end()) break;
+            itr = child;
+        }
+        if (key_itr == key.end()) {
+            raise_best(itr, rank);
+            return { itr, false };
+        }
+        for(auto last = std::prev(key.end()); key_itr != last; ++key_itr) {
+            itr = itr->children.insert(*key_itr);
+            raise_best(itr, rank);
+        }
+        itr = itr->children.insert(*key_itr, std::forward<args_type>(args)...);
+        raise_best(itr, rank);
+        return { itr, true };
+    }
+
+    // Node whose prefix leaves key part way is split there, upper part keeps
+    // common prefix and lower part keeps rest of prefix, value and children.
+    template <typename lookup_type, typename... args_type>
+    std::pair<iterator, bool> emplace_compressed(const lookup_type& key, const value_type *rank, args_type&&... args) {
+        iterator itr = &root;
+        size_t position = 0;
+        while(true) {
+            auto &prefix = itr->children.prefix;
+            size_t common = 0;
+            while(common < prefix.size() && position + common < key.size() && prefix[common] == key[position + common]) {
+                ++common;
+            }
+            if (common < prefix.size()) {
+                auto rest = new node_type();
+                if constexpr (ranked) rest->best = itr->best;
+                rest->value = std::exchange(itr->value, default_value<value_type>::value);
+                rest->children.swap(itr->children);
+                auto &rest_prefix = rest->children.prefix;
+                itr->children.prefix.assign(rest_prefix, 0, common);
+                auto key_char = rest_prefix[common];
+                rest_prefix.erase(0, common + 1);
+                itr->children.attach(key_char, rest);
+            }
+            raise_best(itr, rank);
+            position += common;
+            if (position == key.size()) return { itr, false };
+
+            auto child = itr->children.find(key[position]);
+            if (child == itr->children.end()) {
+                itr = itr->children.insert(key[position], std::forward<args_type>(args)...);
+                itr->children.prefix.assign(key.begin() + position + 1, key.end());
+                raise_best(itr, rank);
+                return { itr, true };
+            }
+            itr = child;
+            ++position;
+        }
+    }
+
+    // Default value marks a missing key, so an existing node holding it is
+    // filled as if it was new. assign replaces a value already present.
+    template <bool assign, typename lookup_type, typename... args_type>
+    std::pair<iterator, bool> emplace_value(const lookup_type& key, args_type&&... args) {
+        if constexpr (ranked) {
+            // Ranked values are arithmetic, built first so that subtree
+            // maxima are raised on the way down
+            value_type value(std::forward<args_type>(args)...);
+            auto [itr, created] = emplace_node(key, &value, value);
+            bool inserted = created || itr->value == default_value<value_type>::value;
+            if (!created && (inserted || assign)) itr->value = value;
+            return { itr, inserted };
+        } else {
+            auto [itr, created] = emplace_node(key, nullptr, std::forward<args_type>(args)...);
+            bool inserted = created || itr->value == default_value<value_type>::value;
+            if (!created && (inserted || assign)) {
+                if constexpr (sizeof...(args_type) == 1 && (std::is_assignable_v<value_type &, args_type> && ...)) {
+                    ((itr->value = std::forward<args_type>(args)), ...);
+                } else {
+                    itr->value = value_type(std::forward<args_type>(args)...);
                 }
-                break;
             }
-            itr = child_itr;
+            return { itr, inserted };
         }
-        itr->value = value;
     }
 
-    auto search(const key_type& key) {
+    // Walks key one node further from itr, position is count of key
+    // characters consumed. Returns false once walk is over, itr is then node
+    // of key or end(). Shared by search and contains_batch.
+    template <typename view_type>
+    bool search_step(const view_type& key, iterator &itr, size_t &position) {
+        if constexpr (path_compressed) {
+            auto &prefix = itr->children.prefix;
+            if (key.size() - position < prefix.size() ||
+                !std::equal(prefix.begin(), prefix.end(), key.begin() + position)) {
+                itr = end();
+                return false;
+            }
+            position += prefix.size();
+        }
+        if (position == key.size()) return false;
+
+        itr = itr->children.find(key[position]);
+        ++position;
+        return itr != end();
+    }
+
+    // Node below which every key starts with prefix, key gets full key of that
+    // node. It is longer than prefix when prefix ends inside a compressed prefix.
+    template <typename view_type>
+    iterator locate_prefix(const view_type& prefix, key_type &key) {
+        key.assign(prefix.begin(), prefix.end());
         iterator itr = &root;
-        for(auto key_ch: key) {
-            itr = itr->children.find(key_ch);
-            if (itr == itr->children.end()) {
+        size_t position = 0;
+        while(true) {
+            if constexpr (path_compressed) {
+                auto &node_prefix = itr->children.prefix;
+                auto remaining = prefix.size() - position;
+                if (remaining <= node_prefix.size()) {
+                    if (!std::equal(prefix.begin() + position, prefix.end(), node_prefix.begin())) return end();
+                    key.append(node_prefix, remaining);
+                    return itr;
+                }
+                if (!std::equal(node_prefix.begin(), node_prefix.end(), prefix.begin() + position)) return end();
+                position += node_prefix.size();
+            } else if (position == prefix.size()) {
+                return itr;
+            }
+
+            auto child = itr->children.find(prefix[position]);
+            if (child == itr->children.end()) {
                 return end();
             }
+            itr = child;
+            ++position;
         }
+    }
+
+public:
+    using prefix_range = tries_prefix_range<key_type, node_type>;
+
+    tries() {}
+
+    // Key arguments may be key_type, any tries_key such as std::string_view,
+    // or const key_char_type *. Nothing is allocated for lookup.
 
+    // Duplicate will be overridden, value is forwarded so an rvalue is moved
+    template <tries_lookup<key_char_type> lookup_type = key_type, typename mapped_type = value_type>
+    void insert(const lookup_type& key, mapped_type&& value) {
+        emplace_value<true>(key_view(key), std::forward<mapped_type>(value));
+    }
+
+    // Value built in place from args only if key is missing, an existing
+    // value is left as it is and args are untouched. Second is true when
+    // value was built.
+    template <tries_lookup<key_char_type> lookup_type = key_type, typename... args_type>
+    std::pair<iterator, bool> try_emplace(const lookup_type& key, args_type&&... args) {
+        return emplace_value<false>(key_view(key), std::forward<args_type>(args)...);
+    }
+
+    // Value built in place from args only if key is missing, as std::map
+    // emplace an existing value is left untouched.
+    template <tries_lookup<key_char_type> lookup_type = key_type, typename... args_type>
+    std::pair<iterator, bool> emplace(const lookup_type& key, args_type&&... args) {
+        return emplace_value<false>(key_view(key), std::forward<args_type>(args)...);
+    }
+
+    // Value forwarded into a new node, or assigned to existing one
+    template <tries_lookup<key_char_type> lookup_type = key_type, typename mapped_type = value_type>
+    std::pair<iterator, bool> insert_or_assign(const lookup_type& key, mapped_type&& value) {
+        return emplace_value<true>(key_view(key), std::forward<mapped_type>(value));
+    }
+
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    iterator search(const lookup_type& lookup) {
+        auto &&key = key_view(lookup);
+        iterator itr = &root;
+        size_t position = 0;
+        while(search_step(key, itr, position)) { }
         return itr;
     }
 
-    bool contains(const key_type& key) {
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    bool contains(const lookup_type& key) {
         auto result = search(key);
         if (result == end()) {
             return false;
@@ -167,13 +1126,150 @@ public:
         return root.end();
     }
 
+    // Descents in flight at once in contains_batch
+    static constexpr size_t batch_width = 16;
+
+    // results[i] gets contains(keys[i]), results must hold at least
+    // keys.size() entries. Up to batch_width walks are interleaved one node
+    // at a time, and node each walk moves to is prefetched, so cache misses
+    // of different keys overlap. A finished walk takes next key right away.
+    template <typename lookup_type = key_type>
+        requires std::convertible_to<const lookup_type &, key_view_type>
+    void contains_batch(std::span<const std::type_identity_t<lookup_type>> keys, std::span<bool> results) {
+        assert(results.size() >= keys.size());
+        struct lane {
+            size_t index;
+            key_view_type key;
+            iterator itr;
+            size_t position;
+        };
+        lane lanes[batch_width];
+        size_t active = 0;
+        size_t next = 0;
+        for(; active < batch_width && next < keys.size(); ++active, ++next) lanes[active] = { next, keys[next], &root, 0 };
+
+        while(active) {
+            for(size_t index = 0; index < active;) {
+                auto &current = lanes[index];
+                if (search_step(current.key, current.itr, current.position)) {
+                    __builtin_prefetch(current.itr);
+                    ++index;
+                    continue;
+                }
+                results[current.index] = current.itr != end() && current.itr->value != default_value<value_type>::value;
+                if (next < keys.size()) {
+                    current = { next, keys[next], &root, 0 };
+                    ++next;
+                } else {
+                    current = lanes[--active];
+                }
+            }
+        }
+    }
+
+    // Node of longest stored key which is a prefix of key, or end(). length
+    // gets size of that stored key.
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    iterator longest_prefix_match(const lookup_type& lookup, size_t &length) {
+        auto &&key = key_view(lookup);
+        iterator result = end();
+        iterator itr = &root;
+        size_t position = 0;
+        while(true) {
+            if constexpr (path_compressed) {
+                auto &prefix = itr->children.prefix;
+                if (key.size() - position < prefix.size() ||
+                    !std::equal(prefix.begin(), prefix.end(), key.begin() + position)) {
+                    break;
+                }
+                position += prefix.size();
+            }
+            if (itr->value != default_value<value_type>::value) {
+                result = itr;
+                length = position;
+            }
+            if (position == key.size()) break;
+
+            auto child = itr->children.find(key[position]);
+            if (child == itr->children.end()) break;
+            itr = child;
+            ++position;
+        }
+        return result;
+    }
+
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    iterator longest_prefix_match(const lookup_type& key) {
+        size_t length;
+        return longest_prefix_match(key, length);
+    }
+
+    // (key, value) of every stored key starting with prefix, walked lazily
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    prefix_range with_prefix(const lookup_type& prefix) {
+        key_type key;
+        auto start = locate_prefix(key_view(prefix), key);
+        return prefix_range(start, std::move(key));
+    }
+
+    // Up to k (key, value) with largest values among keys starting with prefix,
+    // largest first. Best first search on subtree maxima, a subtree is expanded
+    // only once its maximum beats every pending result.
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    std::vector<std::pair<key_type, value_type>> top_k_completions(const lookup_type& prefix, size_t k)
+        requires tries_ranked_value<value_type>
+    {
+        struct candidate {
+            value_type bound;
+            node_type *node;
+            key_type key;
+            bool stored;    // bound is value of node itself, not its subtree
+        };
+        auto lower = [](const candidate &left, const candidate &right) { return left.bound < right.bound; };
+        std::priority_queue<candidate, std::vector<candidate>, decltype(lower)> queue(lower);
+
+        std::vector<std::pair<key_type, value_type>> result;
+        key_type key;
+        auto start = locate_prefix(key_view(prefix), key);
+        if (start == end() || k == 0) return result;
+
+        queue.push({ start->best, start, std::move(key), false });
+        while(!queue.empty() && result.size() < k) {
+            auto top = queue.top();
+            queue.pop();
+            if (top.stored) {
+                result.emplace_back(std::move(top.key), top.bound);
+                continue;
+            }
+            auto node = top.node;
+            if (node->value != default_value<value_type>::value) queue.push({ node->value, node, top.key, true });
+            node->children.for_each_child([&queue, &top](auto key_char, node_type *child) {
+                auto child_key = top.key;
+                child_key.push_back(key_char);
+                if constexpr (path_compressed) child_key.append(child->children.prefix);
+                queue.push({ child->best, child, std::move(child_key), false });
+            });
+        }
+        return result;
+    }
+
+    // Visits (key, value) of every stored key. Order follows child order of
+    // TLIST, so it is sorted only for ordered TLIST.
+    template <typename function_type>
+    void for_each(function_type &&function) {
+        key_type key;
+        for_each(&root, key, function);
+    }
+
 };
 
 template <typename key_type, typename TLIST>
 class tries_set : public tries<key_type, bool, TLIST> {
     using tries_type = tries<key_type, bool, TLIST>;
+    using key_char_type = key_type::value_type;
 public:
-    void insert(key_type& key) {
+    template <tries_lookup<key_char_type> lookup_type = key_type>
+    void insert(const lookup_type& key) {
         tries_type::insert(key, true);
     }
 };
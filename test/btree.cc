@@ -0,0 +1,93 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <btree.hh>
+#include <tries.hh>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <iostream>
+
+typedef rohit::tries_set<std::string, rohit::tries_btree<std::string>> string_tries;
+
+int main(int argc, char *argv[]) {
+    constexpr int values[] = {
+        80, 60, 90, 33, 125, 22, 88, 66, 24, 11, 13, 111, 215, 86, 25, 35, 86, 12, 13, 113, 118, 18,
+        1, 201, 2, 202, 302, 3, 203, 303, 403, 4, 104, 204, 304, 404, 5, 105, 205, 305, 405,
+        6, 406, 306, 206, 106, 107, 7, 207, 407, 307, 8, 408, 108, 208, 308,
+        501, 502, 503, 504, 505, 506, 507, 508, 509,
+        601, 602, 603, 604, 605, 606, 607, 608, 609, 610,
+        701, 702, 703, 704, 705, 706, 707, 708, 709, 710
+    };
+
+    // Small nodes so that the sample splits a few levels deep
+    rohit::btree<int, int, 64> tree;
+    for(auto value: values) {
+        tree.insert(value, value * 10);
+    }
+
+    std::cout << "Size: " << tree.size() << "; depth: " << tree.depth() << std::endl;
+    std::cout << "Inorder:";
+    int previous = -1;
+    for(auto entry: tree) {
+        assert(previous < entry.key);
+        assert(entry.value == entry.key * 10);
+        previous = entry.key;
+        std::cout << " " << entry.key;
+    }
+    std::cout << std::endl;
+
+    for(auto value: values) {
+        assert(tree.find(value) != tree.end());
+    }
+    assert(tree.find(0) == tree.end());
+    assert(tree.find(711) == tree.end());
+
+    std::cout << "Range [300, 500):";
+    for(auto itr = tree.lower_bound(300); itr != tree.end() && itr->key < 500; ++itr) {
+        std::cout << " " << itr->key;
+    }
+    std::cout << std::endl;
+
+    // Keys across sign boundary exercise the unsigned and floating point kernels
+    rohit::btree<uint32_t, bool> unsigned_tree;
+    rohit::btree<double, bool> double_tree;
+    for(uint32_t value = 0; value < 2000; ++value) {
+        unsigned_tree.insert(value * 2147483u, true);
+        double_tree.insert(value * 0.5 - 500.0, true);
+    }
+    for(uint32_t value = 0; value < 2000; ++value) {
+        assert(unsigned_tree.find(value * 2147483u) != unsigned_tree.end());
+        assert(unsigned_tree.find(value * 2147483u + 1) == unsigned_tree.end());
+        assert(double_tree.find(value * 0.5 - 500.0) != double_tree.end());
+        assert(double_tree.find(value * 0.5 - 499.75) == double_tree.end());
+    }
+    std::cout << "Unsigned size: " << unsigned_tree.size() << "; double size: " << double_tree.size() << std::endl;
+
+    string_tries set_tries;
+    std::vector<std::string> data = {
+        "This", "Rohit", "Classical", "Rohit Singh", "Thakur", "Thakurana", "Questions", "Quest", "Classic", "unknown"
+    };
+    for(auto value: data) {
+        set_tries.insert(value);
+    }
+
+    std::vector<std::string> search_data = { "Rohit", "Thakurana", "Class", "Hero" };
+    for(auto &value: search_data) {
+        std::cout << "Search: " << value << " - " << (set_tries.contains(value) ? "true" : "false") << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <concurrent_tree.hh>
+#include <assert.h>
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Copy throws once copies_left runs out, -1 never throws
+struct fragile {
+    static inline int copies_left = -1;
+    int value;
+
+    fragile(int value) : value(value) { }
+    fragile(const fragile &other) : value(other.value) {
+        if (copies_left == 0) throw std::runtime_error("fragile copy");
+        if (copies_left > 0) --copies_left;
+    }
+    fragile &operator=(const fragile &) = default;
+};
+
+template <rohit::blancing_type impl>
+void check(const char *name) {
+    constexpr int reader_count = 3;
+    constexpr int max_value = 20000;
+
+    rohit::concurrent_bst<int, int, impl> tree;
+    // Scattered order keeps unbalanced tree shallow
+    constexpr int half = max_value / 2;
+    for(int index = 0; index < half; ++index) {
+        auto value = index * 7919 % half * 2;
+        tree.insert(value, value);
+    }
+
+    // Even keys never change value, odd keys are being added by writer
+    std::atomic<bool> done { false };
+    std::vector<std::thread> readers;
+    for(int index = 0; index < reader_count; ++index) {
+        readers.emplace_back([&tree, &done, index] {
+            int value = index;
+            while(!done.load(std::memory_order_relaxed)) {
+                value = (value + 7919) % max_value;
+                auto found = tree.find(value);
+                if (value % 2 == 0) {
+                    assert(found != tree.end() && found->value == value);
+                } else if (found != tree.end()) {
+                    assert(found->value == value);
+                }
+            }
+        });
+    }
+
+    for(int index = 0; index < half; ++index) {
+        auto value = index * 7919 % half * 2 + 1;
+        tree.insert(value, value);
+    }
+    done = true;
+    for(auto &reader: readers) reader.join();
+
+    for(int value = 0; value < max_value; ++value) {
+        assert(tree.contains(value));
+    }
+    assert(!tree.contains(max_value));
+    assert(tree.size() == max_value);
+
+    std::cout << name << ": size " << tree.size() << std::endl;
+
+    // Failed write frees its copies and leaves published tree as it was
+    rohit::concurrent_bst<int, fragile, impl> fragile_tree;
+    for(int value = 0; value < 64; ++value) fragile_tree.insert(value * 7 % 64, value);
+    fragile::copies_left = 3;
+    bool thrown = false;
+    try {
+        fragile_tree.insert(100, 100);
+    } catch(const std::runtime_error &) {
+        thrown = true;
+    }
+    fragile::copies_left = -1;
+    assert(thrown && fragile_tree.size() == 64 && !fragile_tree.contains(100));
+    for(int value = 0; value < 64; ++value) {
+        assert(fragile_tree.find(value * 7 % 64)->value.value == value);
+    }
+    fragile_tree.insert(100, 100);
+    assert(fragile_tree.contains(100));
+}
+
+int main(int argc, char *argv[]) {
+    check<rohit::blancing_type::none>("none");
+    check<rohit::blancing_type::red_black>("red_black");
+    check<rohit::blancing_type::red_black_leftleaning>("red_black_leftleaning");
+    check<rohit::blancing_type::avl>("avl");
+
+    rohit::epoch_domain::global().reclaim();
+    std::cout << "Pending reclaim: " << rohit::epoch_domain::global().pending() << std::endl;
+    return 0;
+}
@@ -0,0 +1,120 @@
+/* @ Rohit Jairaj Singh - rohit@singh.org.in
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <concurrent_tries.hh>
+#include <assert.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::string make_key(int value) {
+    // Shared prefixes make many keys meet in same nodes of a shard
+    return "key/" + std::to_string(value % 97) + "/" + std::to_string(value);
+}
+
+int main(int argc, char *argv[]) {
+    constexpr int writer_count = 4;
+    constexpr int reader_count = 2;
+    constexpr int max_value = 40000;
+
+    // Even keys are present before threads start and keep their value, odd
+    // keys are added by writers while readers look
+    rohit::concurrent_tries<std::string, int> tries;
+    for(int value = 0; value < max_value; value += 2) {
+        tries.insert(make_key(value), value + 1);
+    }
+
+    std::atomic<bool> done { false };
+    std::vector<std::thread> readers;
+    for(int index = 0; index < reader_count; ++index) {
+        readers.emplace_back([&tries, &done, index] {
+            int value = index;
+            while(!done.load(std::memory_order_relaxed)) {
+                value = (value + 7919) % max_value;
+                auto found = tries.search(make_key(value));
+                if (value % 2 == 0) {
+                    assert(found != tries.end() && found->value == value + 1);
+                } else if (found != tries.end() && found->value != 0) {
+                    // Node of an odd key may be seen before its value
+                    assert(found->value == value + 1);
+                }
+                // Prefix of a key is never a key
+                assert(!tries.contains("key/" + std::to_string(value % 97)));
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for(int index = 0; index < writer_count; ++index) {
+        writers.emplace_back([&tries, index] {
+            for(int value = 2 * index + 1; value < max_value; value += 2 * writer_count) {
+                tries.insert(make_key(value), value + 1);
+            }
+        });
+    }
+    for(auto &writer: writers) writer.join();
+    done = true;
+    for(auto &reader: readers) reader.join();
+
+    // Every write of every writer is visible once writers are joined
+    for(int value = 0; value < max_value; ++value) {
+        assert(tries.search(make_key(value))->value == value + 1);
+    }
+    assert(tries.size() == max_value);
+    assert(!tries.contains("") && !tries.contains("key") && !tries.contains(make_key(max_value)));
+
+    // Assigning default value removes key from size and contains
+    tries.insert(make_key(0), 0);
+    assert(!tries.contains(make_key(0)) && tries.size() == max_value - 1);
+
+    rohit::concurrent_tries_set<std::string, 4> set;
+    set.insert("");
+    set.insert("a");
+    set.insert("abc");
+    assert(set.contains("") && set.contains("a") && !set.contains("ab") && set.contains(std::string("abc")));
+    // Keys ending inside or leaving an unexpanded tail
+    set.insert("xyz/long/tail");
+    set.insert("xyz/lo");
+    set.insert("xyz/list");
+    assert(set.contains("xyz/long/tail") && set.contains("xyz/lo") && set.contains("xyz/list"));
+    assert(!set.contains("xyz/l") && !set.contains("xyz/long") && !set.contains("xyz/long/tails"));
+    assert(set.size() == 6);
+    // One shard, compressed path is cut where a key ends or leaves it and
+    // full blocks grow
+    rohit::concurrent_tries_set<std::string, 1> paths;
+    paths.insert("prefix/shared/end");
+    paths.insert("prefix/shared");
+    paths.insert("prefix/sh");
+    paths.insert("prefix/other");
+    for(char key_char = '0'; key_char <= 'z'; ++key_char) paths.insert(std::string("prefix/") + key_char);
+    assert(paths.contains("prefix/shared/end") && paths.contains("prefix/shared") && paths.contains("prefix/sh"));
+    assert(paths.contains("prefix/other") && paths.contains("prefix/0") && paths.contains("prefix/z") && paths.contains("prefix/s"));
+    assert(!paths.contains("prefix/") && !paths.contains("prefix/shared/") && !paths.contains("prefix/shar") && !paths.contains("prefix/zz"));
+    assert(paths.search("prefix/shared/e") == paths.end() && paths.search("prefix/o") != paths.end());
+    assert(paths.size() == 4 + ('z' - '0' + 1));
+    // Iterator keeps its node readable after writers replaced it
+    auto held = paths.search("prefix/sh");
+    for(int value = 0; value < 4000; ++value) paths.insert("prefix/sh" + std::to_string(value));
+    rohit::epoch_domain::global().reclaim();
+    assert(held != paths.end() && held->value && paths.contains("prefix/sh3999"));
+    held = paths.end();
+
+    rohit::epoch_domain::global().reclaim();
+    std::cout << "Concurrent tries size: " << tries.size() << "; pending reclaim: " << rohit::epoch_domain::global().pending() << std::endl;
+    return 0;
+}
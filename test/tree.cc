@@ -15,9 +15,88 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <tree.hh>
 #include <tree_display.hh>
+#include <flat_tree.hh>
+#include <tree_traversal.hh>
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <assert.h>
+#include <vector>
+
+// Returns avl height or black height of subtree. Key order, parent links,
+// subtree sizes and balancing rules are asserted on the way down.
+template <rohit::blancing_type impl, typename node_type>
+int check_subtree(const node_type *node, const std::type_identity_t<node_type> *low, const std::type_identity_t<node_type> *high, size_t &size) {
+    size = 0;
+    if (node == nullptr) return 0;
+    assert(low == nullptr || low->key < node->key);
+    assert(high == nullptr || node->key < high->key);
+    assert(node->left == nullptr || node->left->parent == node);
+    assert(node->right == nullptr || node->right->parent == node);
+    size_t left_size, right_size;
+    auto left = check_subtree<impl>(node->left, low, node, left_size);
+    auto right = check_subtree<impl>(node->right, node, high, right_size);
+    size = left_size + right_size + 1;
+    assert(node->size == size);
+    if constexpr (impl == rohit::blancing_type::avl) {
+        assert(std::abs(left - right) <= 1 && node->count == std::max(left, right) + 1);
+        return node->count;
+    } else {
+        assert(left == right);
+        assert(!node->red || ((node->left == nullptr || !node->left->red) && (node->right == nullptr || !node->right->red)));
+        if constexpr (impl == rohit::blancing_type::red_black_leftleaning) assert(node->right == nullptr || !node->right->red);
+        return left + !node->red;
+    }
+}
+
+template <typename tree_type>
+concept splittable = requires(tree_type &tree) { tree.split(1); };
+
+// Random mix of every insert flavour and erase, invariants checked as tree
+// grows and shrinks
+template <rohit::blancing_type impl>
+void check_random_updates() {
+    constexpr int key_range = 2000;
+    rohit::bst<int, int, impl, rohit::order_statistic> tree;
+    std::vector<bool> present(key_range);
+    size_t expected = 0;
+    std::mt19937 random(static_cast<unsigned>(impl) + 1);
+    for(int round = 1; round <= 20000; ++round) {
+        int key = random() % key_range;
+        switch(random() % 5) {
+        case 0: tree.insert(key, key); break;
+        case 1: tree.try_emplace(key, key); break;
+        case 2: tree.insert_or_assign(key, key); break;
+        case 3: tree.emplace(key, key); break;
+        default:
+            // Present keys are erased by key or through an iterator
+            if (present[key] && round % 2) tree.erase(tree.find(key));
+            else assert(tree.erase(key) == (present[key] ? 1u : 0u));
+            expected -= present[key];
+            present[key] = false;
+            continue;
+        }
+        expected += !present[key];
+        present[key] = true;
+        if (round % 500 == 0) {
+            size_t size;
+            assert(tree.root == nullptr || tree.root->parent == nullptr);
+            if constexpr (impl != rohit::blancing_type::avl) assert(tree.root == nullptr || !tree.root->red);
+            check_subtree<impl>(tree.root, nullptr, nullptr, size);
+            assert(size == expected && tree.size() == expected);
+        }
+    }
+}
 
 int main(int argc, char *argv[]) {
-    constexpr int values[] = {
+    static constexpr int values[] = {
         80, 60, 90, 33, 125, 22, 88, 66, 24, 11, 13, 111, 215, 86, 25, 35, 86, 12, 13, 113, 118, 18,
         1, 201, 2, 202, 302, 3, 203, 303, 403, 4, 104, 204, 304, 404, 5, 105, 205, 305, 405,
         6, 406, 306, 206, 106, 107, 7, 207, 407, 307, 8, 408, 108, 208, 308,
@@ -42,5 +121,301 @@ int main(int argc, char *argv[]) {
         display_tree(tree);
     }
 
+    for(size_t index = 0; index < std::size(values); index += 2) {
+        tree.erase(values[index]);
+    }
+    std::cout << "After erasing every other value: ";
+    rohit::display_inorder(tree);
+    std::cout << std::endl;
+    display_tree(tree);
+
+    tree.clear();
+    std::cout << "After clear depth: " << tree.depth() << std::endl;
+
+    check_random_updates<rohit::blancing_type::red_black>();
+    check_random_updates<rohit::blancing_type::red_black_leftleaning>();
+    check_random_updates<rohit::blancing_type::avl>();
+
+    // Copies and rebinds of slab_allocator share one pool
+    rohit::slab_allocator<int> slab;
+    auto slab_value = slab.allocate(1);
+    rohit::slab_allocator<int> slab_copy(slab);
+    rohit::slab_allocator<double> slab_rebound(slab);
+    assert(slab_copy == slab && rohit::slab_allocator<int>(slab_rebound) == slab && slab.shared());
+    slab_copy.deallocate(slab_value, 1);
+    assert(slab.allocate(1) == slab_value);
+    slab.deallocate(slab_value, 1);
+    // Copy taken before first allocation shares pool as well
+    rohit::slab_allocator<int> fresh_slab;
+    rohit::slab_allocator<int> fresh_copy(fresh_slab);
+    auto fresh_value = fresh_slab.allocate(1);
+    assert(fresh_copy == fresh_slab && fresh_slab.shared());
+    fresh_copy.deallocate(fresh_value, 1);
+    assert(fresh_slab.allocate(1) == fresh_value);
+    fresh_slab.deallocate(fresh_value, 1);
+
+    rohit::bst<int, bool, rohit::blancing_type::red_black, rohit::no_augment, std::allocator<int>> heap_tree;
+    for(auto value: values) {
+        heap_tree.insert(value, true);
+    }
+    std::cout << "Heap allocated tree inorder: ";
+    rohit::display_inorder(heap_tree);
+    std::cout << std::endl;
+
+    auto eytzinger = rohit::freeze(heap_tree);
+    auto van_emde_boas = rohit::freeze<rohit::flat_layout::van_emde_boas>(heap_tree);
+    for(auto value: values) {
+        assert(eytzinger.find(value) != eytzinger.end() && eytzinger.find(value)->key == value);
+        assert(van_emde_boas.find(value) != van_emde_boas.end() && van_emde_boas.find(value)->key == value);
+    }
+    for(auto value: { 0, 9, 100, 500, 711 }) {
+        assert(eytzinger.find(value) == eytzinger.end());
+        assert(van_emde_boas.find(value) == van_emde_boas.end());
+    }
+    std::cout << "Frozen size: " << eytzinger.size() << std::endl;
+
+    auto saved_path = (std::filesystem::temp_directory_path() / "rohit_flat_bst.bin").string();
+    rohit::save<rohit::flat_layout::van_emde_boas>(heap_tree, saved_path);
+    auto mapped = rohit::flat_bst<int, bool, rohit::flat_layout::van_emde_boas>::open(saved_path);
+    assert(mapped.size() == van_emde_boas.size());
+    for(auto value: values) {
+        assert(mapped.find(value) != mapped.end());
+    }
+    assert(mapped.find(9) == mapped.end());
+    std::filesystem::remove(saved_path);
+
+    // Same table built during compilation, duplicates collapse
+    constexpr auto constant_tree = rohit::make_constexpr_bst<values>();
+    static_assert(constant_tree.contains(86) && constant_tree.find(9) == constant_tree.end());
+    assert(constant_tree.size() == eytzinger.size());
+    for(auto value: values) {
+        assert(constant_tree.find(value)->key == value);
+    }
+
+    // string_view and char pointer lookups compare in place
+    rohit::bst<std::string, int, rohit::blancing_type::avl> names;
+    names.insert(std::string_view("Rohit"), 1);
+    names.insert("Singh", 2);
+    assert(names.find(std::string_view("Rohit"))->value == 1 && names.find("Singh")->value == 2);
+    assert(names.find(std::string_view("Rohi")) == names.end() && names.lower_bound("S")->key == "Singh");
+
+    // Batched lookups give same answer as find, more keys than batch width
+    // so finished lanes get refilled
+    std::vector<int> batch(std::begin(values), std::end(values));
+    batch.insert(batch.end(), { 0, 9, 100, 500, 711 });
+    std::vector<decltype(heap_tree)::iterator> batch_results(batch.size());
+    heap_tree.find_batch(batch, batch_results);
+    for(size_t index = 0; index < batch.size(); ++index) {
+        assert(batch_results[index] == heap_tree.find(batch[index]));
+    }
+    std::string_view name_batch[] = { "Singh", "Rohi", "Rohit" };
+    decltype(names)::iterator name_results[3];
+    names.find_batch<std::string_view>(name_batch, name_results);
+    assert(name_results[0]->value == 2 && name_results[1] == names.end() && name_results[2]->value == 1);
+
+    for(auto value: values) {
+        heap_tree.erase(value);
+        assert(heap_tree.find(value) == heap_tree.end());
+    }
+    assert(heap_tree.root == nullptr);
+
+    std::vector<std::pair<int, bool>> pairs;
+    for(auto value: values) {
+        pairs.emplace_back(value, true);
+    }
+    rohit::bst<int, bool, rohit::blancing_type::red_black_leftleaning> bulk_tree(pairs.begin(), pairs.end());
+    std::cout << "Bulk loaded tree:" << std::endl;
+    display_tree(bulk_tree);
+
+    std::cout << "Range [300, 500):";
+    for(auto itr = bulk_tree.lower_bound(300); itr != bulk_tree.upper_bound(499); ++itr) {
+        std::cout << " " << itr->key;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Reverse:";
+    for(auto &node: bulk_tree | std::views::reverse) {
+        std::cout << " " << node.key;
+    }
+    std::cout << std::endl;
+
+    assert(std::ranges::is_sorted(bulk_tree, {}, [](auto &node) { return node.key; }));
+    assert(static_cast<size_t>(std::ranges::distance(bulk_tree)) == bulk_tree.size());
+    for(auto itr = bulk_tree.begin(); itr != bulk_tree.end();) {
+        itr = bulk_tree.erase(itr);
+    }
+    assert(bulk_tree.empty());
+
+    rohit::bst<int, bool, rohit::blancing_type::red_black, rohit::order_statistic> ranked_tree;
+    for(auto value: values) {
+        ranked_tree.insert(value, true);
+    }
+    auto median = ranked_tree.select(ranked_tree.size() / 2);
+    std::cout << "Median: " << median->key << "; rank of 300: " << ranked_tree.rank(300)
+        << "; count in [300, 500): " << ranked_tree.count_range(300, 500) << std::endl;
+    assert(ranked_tree.rank(median->key) == ranked_tree.size() / 2);
+    assert(ranked_tree.count_range(300, 500) == 13);
+
+    // Statistics policy, sorted input makes every tree rebalance. Stats
+    // wrap order_statistic without changing rank and select.
+    rohit::bst<int, bool, rohit::blancing_type::avl, rohit::with_stats<rohit::order_statistic>> avl_stats;
+    rohit::bst<int, bool, rohit::blancing_type::red_black, rohit::with_stats<rohit::no_augment>> red_black_stats;
+    rohit::bst<int, bool, rohit::blancing_type::red_black_leftleaning, rohit::with_stats<rohit::no_augment>> leftleaning_stats;
+    for(int value = 0; value < 1000; ++value) {
+        avl_stats.insert(value, true);
+        red_black_stats.insert(value, true);
+        leftleaning_stats.insert(value, true);
+    }
+    for(int value = 0; value < 1000; value += 2) {
+        assert(avl_stats.find(value) != avl_stats.end() && red_black_stats.find(value + 1) != red_black_stats.end());
+    }
+    assert(avl_stats.find(-1) == avl_stats.end());
+    auto avl_counts = avl_stats.stats();
+    auto red_black_counts = red_black_stats.stats();
+    auto leftleaning_counts = leftleaning_stats.stats();
+    assert(avl_counts.size == 1000 && avl_counts.allocations == 1000 && avl_counts.deallocations == 0);
+    // New node is placed before rebalance, one below final height at most
+    assert(avl_counts.height_bound == avl_stats.depth() && avl_counts.max_depth <= avl_counts.height_bound + 1);
+    assert(avl_counts.rotations > 0 && avl_counts.color_flips == 0 && avl_counts.insert_visits > 0);
+    assert(avl_counts.lookups == 501 && avl_counts.lookup_comparisons == 2 * avl_counts.lookup_visits - 500);
+    assert(red_black_counts.rotations > 0 && red_black_counts.color_flips > 0 && red_black_counts.lookups == 500);
+    assert(red_black_counts.max_depth >= red_black_stats.depth() && red_black_counts.height_bound >= red_black_stats.depth());
+    assert(red_black_counts.black_height > 0 && red_black_counts.height_bound == 2 * red_black_counts.black_height);
+    assert(leftleaning_counts.rotations > 0 && leftleaning_counts.color_flips > 0 && leftleaning_counts.lookups == 0);
+    assert(leftleaning_counts.black_height > 0 && leftleaning_counts.height_bound >= leftleaning_stats.depth());
+    assert(avl_counts.black_height == 0);
+    assert(avl_stats.select(500)->key == 500 && avl_stats.rank(500) == 500);
+    std::cout << "Rotations per insert avl: " << static_cast<double>(avl_counts.rotations) / avl_counts.allocations
+        << "; red_black: " << static_cast<double>(red_black_counts.rotations) / red_black_counts.allocations
+        << "; red_black_leftleaning: " << static_cast<double>(leftleaning_counts.rotations) / leftleaning_counts.allocations << std::endl;
+    for(int value = 0; value < 1000; value += 2) {
+        red_black_stats.erase(value);
+    }
+    assert(red_black_stats.stats().deallocations == 500);
+    assert(red_black_stats.stats().height_bound >= red_black_stats.depth());
+    red_black_stats.reset_stats();
+    assert(red_black_stats.stats().rotations == 0 && red_black_stats.stats().max_depth > 0);
+    // Unbalanced tree height is deepest insert, sorted input chains every node
+    rohit::bst<int, bool, rohit::blancing_type::none, rohit::with_stats<rohit::no_augment>> chain_stats;
+    for(int value = 0; value < 100; ++value) chain_stats.insert(value, true);
+    assert(chain_stats.stats().height_bound == 100 && chain_stats.depth() == 100);
+    chain_stats.erase(50);
+    assert(chain_stats.stats().height_bound >= chain_stats.depth() && chain_stats.stats().black_height == 0);
+    red_black_stats.clear();
+    assert(red_black_stats.stats().deallocations == 500 && red_black_stats.stats().max_depth == 0);
+    // Disabled policy adds no state to tree
+    static_assert(sizeof(rohit::bst<int, bool, rohit::blancing_type::avl, rohit::no_augment, std::allocator<int>>) == sizeof(void *) + sizeof(size_t));
+
+    // Values built in place, existing value is kept by try_emplace and emplace
+    rohit::bst<std::string, std::vector<int>, rohit::blancing_type::avl> lists;
+    auto [list, created] = lists.try_emplace(std::string("odd"), 3, 1);
+    assert(created && list->value == std::vector<int>(3, 1));
+    assert(!lists.try_emplace(std::string_view("odd"), 5, 0).second && list->value.size() == 3);
+    assert(!lists.emplace(std::string("odd"), 2, 7).second && lists.find("odd")->value == std::vector<int>(3, 1));
+    assert(lists.emplace(std::string("even"), 2, 7).second && lists.find("even")->value == std::vector<int>(2, 7));
+    std::vector<int> primes { 2, 3, 5 };
+    lists.insert_or_assign(std::string("prime"), std::move(primes));
+    assert(primes.empty() && lists.find("prime")->value.size() == 3);
+
+    // Parallel traversals split at subtree boundaries, result matches inorder
+    rohit::thread_pool pool(3);
+    rohit::bst<int, int, rohit::blancing_type::avl> wide_tree;
+    rohit::bst<int, int, rohit::blancing_type::none, rohit::order_statistic> chain_tree;
+    for(int value = 0; value < 5000; ++value) {
+        wide_tree.insert(value * 7 % 5003, value);
+        chain_tree.insert(value, value);
+    }
+    auto expected = rohit::inorder(wide_tree);
+    assert(rohit::parallel_inorder(wide_tree, pool) == expected);
+    assert(rohit::parallel_inorder(chain_tree, pool) == rohit::inorder(chain_tree));
+    std::vector<std::pair<int, int>> ordered(chain_tree.size());
+    rohit::parallel_inorder(chain_tree, ordered.begin(), pool);
+    assert(ordered.front().first == 0 && ordered.back().first == 4999);
+    // Sorted inserts chain every node, split stays within depth of piece target
+    auto chain_pieces = rohit::split_inorder(chain_tree, pool);
+    size_t piece_limit = (size_t { 2 } << std::bit_width(8 * (pool.size() + 1))) - 1;
+    size_t chain_nodes = 0;
+    for(auto &piece: chain_pieces) chain_nodes += piece.subtree ? piece.node->size : 1;
+    assert(chain_pieces.size() <= piece_limit && chain_nodes == chain_tree.size());
+    auto wide_pieces = rohit::split_inorder(wide_tree, pool);
+    assert(wide_pieces.size() > 8 && wide_pieces.size() <= piece_limit);
+
+    rohit::parallel_for_each(wide_tree, [](auto &node) { node.value *= 2; }, pool);
+    auto sum = rohit::parallel_reduce(wide_tree, int64_t { 0 }, std::plus<>(), [](auto &node) { return int64_t { node.value }; }, pool);
+    assert(sum == int64_t { 4999 } * 5000);
+    // Concatenation is associative only, pieces must combine in order
+    auto keys = rohit::parallel_reduce(chain_tree, std::string(),
+        [](std::string lhs, const std::string &rhs) { return lhs + rhs; },
+        [](auto &node) { return std::string(1, static_cast<char>('a' + node.key % 26)); }, pool);
+    assert(keys.size() == 5000 && keys.compare(0, 27, "abcdefghijklmnopqrstuvwxyza") == 0);
+    std::cout << "Parallel sum: " << sum << std::endl;
+
+    // Streaming traversals give node references, pairs are copied only on request
+    std::vector<int> streamed;
+    rohit::inorder(wide_tree, std::back_inserter(streamed), [](auto &node) { return node.key; });
+    assert(streamed.size() == expected.size() && std::ranges::is_sorted(streamed));
+    size_t node_count = 0;
+    for(auto &node: rohit::postorder_nodes(wide_tree)) {
+        assert(node.left == nullptr || node.left->key < node.key);
+        ++node_count;
+    }
+    assert(node_count == wide_tree.size());
+    auto preorder_keys = rohit::preorder(wide_tree);
+    auto preorder_itr = preorder_keys.begin();
+    assert(rohit::visit_preorder(wide_tree, [&](auto &node) { return node.key == (preorder_itr++)->first; }));
+    int visited = 0;
+    assert(!rohit::visit_inorder(chain_tree, [&](auto &node) { ++visited; return node.key < 9; }));
+    assert(visited == 10);
+
+    // Shards merged by join based set operations, other shard is consumed
+    rohit::bst<int64_t, int, rohit::blancing_type::red_black> shard, other_shard;
+    for(int64_t value = 0; value < 3000; ++value) {
+        shard.insert(value * 2, 0);
+        if (value % 3 == 0) other_shard.insert(value, 1);
+    }
+    shard.union_with(other_shard, pool);
+    assert(shard.size() == 3500 && other_shard.empty());
+    assert(shard.find(3)->value == 1 && shard.find(6)->value == 1 && shard.find(4)->value == 0);
+    rohit::bst<int64_t, int, rohit::blancing_type::red_black> odd;
+    for(int64_t value = 1; value < 6000; value += 2) odd.insert(value, 0);
+    shard.difference_with(odd);
+    assert(shard.size() == 3000 && std::ranges::all_of(shard, [](auto &node) { return node.key % 2 == 0; }));
+
+    rohit::bst<int, int, rohit::blancing_type::avl, rohit::order_statistic, std::allocator<int>> low, high;
+    for(int value = 0; value < 100; ++value) {
+        low.insert(value, value);
+        high.insert(value + 1000, value);
+    }
+    auto joined = decltype(low)::join(std::move(low), 500, 0, std::move(high));
+    assert(joined.size() == 201 && joined.rank(500) == 100);
+    auto upper = joined.split(1050);
+    assert(joined.size() == 151 && upper.size() == 50 && upper.begin()->key == 1050);
+    rohit::bst<int, int, rohit::blancing_type::avl, rohit::order_statistic, std::allocator<int>> evens;
+    for(int value = 0; value < 2000; value += 2) evens.insert(value, 0);
+    joined.intersection_with(evens);
+    assert(joined.size() == 76 && joined.find(500) != joined.end());
+
+    // Default slab_allocator, split result shares pool and is copied when
+    // merged into a tree of another pool. Much smaller other is inserted.
+    using pooled_tree = rohit::bst<int, int, rohit::blancing_type::red_black, rohit::order_statistic>;
+    // Split stays O(log n) only with subtree sizes
+    static_assert(splittable<pooled_tree> && !splittable<rohit::bst<int, int, rohit::blancing_type::red_black>>);
+    pooled_tree pooled, merged;
+    for(int value = 0; value < 1000; ++value) {
+        pooled.insert(value, value);
+        merged.insert(value + 2000, 0);
+    }
+    auto pooled_upper = pooled.split(600);
+    assert(pooled.size() == 600 && pooled_upper.size() == 400 && pooled_upper.begin()->key == 600);
+    merged.union_with(pooled_upper);
+    assert(merged.size() == 1400 && pooled_upper.empty() && merged.find(999)->value == 999);
+    pooled.clear();
+    assert(merged.find(600) != merged.end() && std::ranges::is_sorted(rohit::inorder(merged)));
+    pooled_tree few;
+    few.insert(2500, 7);
+    few.insert(5000, 7);
+    merged.union_with(few);
+    assert(merged.size() == 1401 && few.empty() && merged.find(2500)->value == 7 && merged.find(5000)->value == 7);
+
     return 0;
 }
\ No newline at end of file
@@ -14,13 +14,22 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <tries.hh>
+#include <static_tries.hh>
+#include <algorithm>
+#include <assert.h>
+#include <filesystem>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
+#include <memory>
 
 typedef rohit::tries_set<std::string, rohit::tries_unordered_map<std::string>> string_tries_old;
 typedef rohit::tries_set<std::string, rohit::tries_tree<std::string, bool, rohit::blancing_type::none>> string_tries_old1;
 typedef rohit::tries_set<std::string, rohit::tries_tree<std::string, bool, rohit::blancing_type::red_black>> string_tries;
+typedef rohit::tries_set<std::string, rohit::tries_art<std::string>> string_tries_art;
+typedef rohit::tries_set<std::string, rohit::tries_flat<std::string>> string_tries_flat;
 
 void insert_all(string_tries &set_tries, const std::vector<std::string> &data) {
     for(auto value: data) {
@@ -40,6 +49,31 @@ void search_all(string_tries &set_tries, const std::vector<std::string> &data) {
     }
 }
 
+// with_prefix walks children through cursor of each TLIST, fan-out is wide
+// enough to reach dense blocks of tries_art and tries_flat
+template <typename set_type>
+void check_with_prefix() {
+    set_type set;
+    std::vector<std::string> keys { "p", "q", "qp" };
+    for(int first = 0; first < 80; ++first) {
+        for(int length = 0; length < first % 5; ++length) {
+            keys.push_back("p" + std::string(1, static_cast<char>('0' + first)) + std::string(length, 'x'));
+        }
+    }
+    for(auto &key: keys) set.insert(key);
+
+    std::vector<std::string> walked;
+    for(auto [key, value]: set.with_prefix(std::string_view("p"))) walked.push_back(key);
+    std::vector<std::string> expected;
+    std::copy_if(keys.begin(), keys.end(), std::back_inserter(expected), [](auto &key) { return key.starts_with("p"); });
+    std::sort(walked.begin(), walked.end());
+    std::sort(expected.begin(), expected.end());
+    assert(walked == expected);
+    size_t count = 0;
+    for(auto [key, value]: set.with_prefix("p4x")) count += key.starts_with("p4x");
+    assert(count == 3);
+}
+
 int main(int argc, char *argv[]) {
     string_tries set_tries;
 
@@ -70,5 +104,182 @@ int main(int argc, char *argv[]) {
 
     search_all(set_tries, data_bad);
 
+    rohit::static_tries<std::string> frozen(set_tries);
+    std::cout << "Static tries size: " << frozen.size() << "; bytes: " << frozen.memory() << std::endl;
+    for(auto &value: data) {
+        assert(frozen.contains(value));
+    }
+    for(auto &value: data_bad) {
+        assert(!frozen.contains(value));
+    }
+    assert(!frozen.contains("Rohi") && !frozen.contains("Rohit S"));
+
+    auto saved_path = (std::filesystem::temp_directory_path() / "rohit_static_tries.bin").string();
+    rohit::save(set_tries, saved_path);
+    auto mapped = rohit::static_tries<std::string>::open(saved_path);
+    assert(mapped.size() == frozen.size());
+    for(auto &value: data) {
+        assert(mapped.contains(value));
+    }
+    for(auto &value: data_bad) {
+        assert(!mapped.contains(value));
+    }
+    std::filesystem::remove(saved_path);
+
+    // Keyword tables built during compilation
+    static constexpr std::string_view verbs[] = { "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "GET" };
+    constexpr auto methods = rohit::make_constexpr_tries<verbs>();
+    static_assert(methods.size() == 6 && methods.contains("PATCH") && !methods.contains("PAT") && !methods.contains("GETS"));
+    for(auto verb: verbs) {
+        assert(methods.contains(verb));
+    }
+    assert(!methods.contains(std::string("get")));
+    static constexpr std::pair<const char *, int> status_codes[] = { { "OK", 200 }, { "Created", 201 }, { "Not Found", 404 }, { "OK", 299 } };
+    constexpr auto status = rohit::make_constexpr_tries<status_codes>();
+    static_assert(*status.search("OK") == 299 && *status.search("Not Found") == 404 && status.search("Not") == status.end());
+
+    // Keys ending inside a compressed prefix split it, wide fan-out grows node
+    // block up to node256
+    string_tries_art art_tries;
+    for(auto value: data) {
+        art_tries.insert(value);
+    }
+    std::vector<std::string> wide;
+    for(int ch = 1; ch < 256; ++ch) {
+        wide.push_back(std::string("Wide") + static_cast<char>(ch));
+        art_tries.insert(wide.back());
+    }
+    for(auto &value: data) {
+        assert(art_tries.contains(value));
+    }
+    for(auto &value: wide) {
+        assert(art_tries.contains(value));
+    }
+    for(auto &value: data_bad) {
+        assert(!art_tries.contains(value));
+    }
+    assert(!art_tries.contains("Rohi") && !art_tries.contains("Rohit S") && !art_tries.contains("Wide"));
+    size_t art_count = 0;
+    std::string previous;
+    art_tries.for_each([&](const std::string &key, bool &) {
+        assert(art_count == 0 || previous < key);
+        previous = key;
+        ++art_count;
+    });
+    assert(art_count == data.size() + wide.size());
+    std::cout << "ART tries size: " << art_count << std::endl;
+
+    // Same keys on flat children, fan-out of Wide node goes through inline,
+    // every sorted block size and dense table
+    string_tries_flat flat_tries;
+    for(auto value: data) {
+        flat_tries.insert(value);
+    }
+    for(auto &value: wide) {
+        flat_tries.insert(value);
+    }
+    for(auto &value: data) {
+        assert(flat_tries.contains(value));
+    }
+    for(auto &value: wide) {
+        assert(flat_tries.contains(value));
+    }
+    for(auto &value: data_bad) {
+        assert(!flat_tries.contains(value));
+    }
+    assert(!flat_tries.contains("Rohi") && !flat_tries.contains("Wide"));
+    size_t flat_count = 0;
+    previous.clear();
+    flat_tries.for_each([&](const std::string &key, bool &) {
+        assert(flat_count == 0 || previous < key);
+        previous = key;
+        ++flat_count;
+    });
+    assert(flat_count == art_count);
+    static_assert(sizeof(rohit::tries_flat<std::string>) <= 5 * sizeof(void *));
+
+    // Fan-out checked at every size, inline search must not match keys
+    // beyond count
+    for(int fanout = 1; fanout < 256; fanout += 7) {
+        rohit::tries<std::string, int, rohit::tries_flat<std::string, int>> flat_map;
+        for(int ch = fanout - 1; ch >= 0; --ch) {
+            flat_map.insert(std::string(1, static_cast<char>(ch)), ch);
+        }
+        for(int ch = 0; ch < 256; ++ch) {
+            auto result = flat_map.search(std::string(1, static_cast<char>(ch)));
+            assert(ch < fanout ? result != flat_map.end() && result->value == ch : result == flat_map.end());
+        }
+    }
+
+    // Batched membership agrees with contains on every TLIST walk
+    std::vector<std::string> batch(data);
+    batch.insert(batch.end(), data_bad.begin(), data_bad.end());
+    batch.insert(batch.end(), wide.begin(), wide.end());
+    auto batch_results = std::make_unique<bool[]>(batch.size());
+    art_tries.contains_batch(batch, { batch_results.get(), batch.size() });
+    for(size_t index = 0; index < batch.size(); ++index) {
+        assert(batch_results[index] == art_tries.contains(batch[index]));
+    }
+    flat_tries.contains_batch(batch, { batch_results.get(), batch.size() });
+    for(size_t index = 0; index < batch.size(); ++index) {
+        assert(batch_results[index] == flat_tries.contains(batch[index]));
+    }
+    std::string_view view_batch[] = { "Rohit", "Rohi", "Wide" };
+    bool view_results[3];
+    flat_tries.contains_batch<std::string_view>(view_batch, view_results);
+    assert(view_results[0] && !view_results[1] && !view_results[2]);
+
+    // Router table: longest stored prefix wins
+    rohit::tries<std::string, int, rohit::tries_art<std::string, int>> routes;
+    routes.insert("/", 1);
+    routes.insert("/api", 2);
+    routes.insert("/api/v1/users", 3);
+    size_t length = 0;
+    auto route = routes.longest_prefix_match("/api/v1/orders", length);
+    assert(route != routes.end() && route->value == 2 && length == 4);
+    assert(routes.longest_prefix_match("/api/v1/users/7")->value == 3);
+    assert(routes.longest_prefix_match("static") == routes.end());
+    std::string_view request = "/api/v1/users/42 HTTP/1.1";
+    assert(routes.longest_prefix_match(request.substr(0, request.find(' ')))->value == 3);
+    assert(routes.contains(request.substr(0, 4)) && !routes.contains(request));
+
+    // Autocomplete with popularity as value
+    rohit::tries<std::string, int, rohit::tries_tree<std::string, int, rohit::blancing_type::red_black>> words;
+    words.insert("car", 50);
+    words.insert("card", 20);
+    words.insert("care", 70);
+    words.insert("cart", 10);
+    words.insert("cat", 90);
+    std::cout << "With prefix car:";
+    size_t with_prefix_count = 0;
+    for(auto [key, value]: words.with_prefix("car")) {
+        std::cout << " " << key << "=" << value;
+        ++with_prefix_count;
+    }
+    std::cout << std::endl;
+    assert(with_prefix_count == 4);
+    check_with_prefix<string_tries_old>();
+    check_with_prefix<string_tries_old1>();
+    check_with_prefix<string_tries>();
+    check_with_prefix<string_tries_art>();
+    check_with_prefix<string_tries_flat>();
+    check_with_prefix<rohit::tries_set<std::string, rohit::tries_btree<std::string>>>();
+    auto top = words.top_k_completions(std::string_view("car"), 2);
+    assert(top.size() == 2 && top[0].first == "care" && top[1].first == "car");
+
+    // Values built in place on created node, default value counts as missing
+    rohit::tries<std::string, std::string, rohit::tries_art<std::string, std::string>> aliases;
+    auto [alias, created] = aliases.try_emplace("ls", 5, 'l');
+    assert(created && alias->value == "lllll");
+    assert(!aliases.try_emplace("ls", "dir").second && alias->value == "lllll");
+    assert(!aliases.emplace("ls", "ls -la", 2).second && aliases.search("ls")->value == "lllll");
+    assert(aliases.emplace("l", "ls -la", 2).second && aliases.search("l")->value == "ls");
+    std::string grep = "grep --color";
+    aliases.insert_or_assign(std::string_view("gr"), std::move(grep));
+    assert(aliases.search("gr")->value == "grep --color");
+    assert(aliases.try_emplace("g", "git").second && aliases.contains("gr"));
+    words.insert_or_assign("cab", 95);
+    assert(words.top_k_completions("ca", 1)[0].first == "cab");
+
     return 0;
 }
\ No newline at end of file